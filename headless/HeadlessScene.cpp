@@ -0,0 +1,114 @@
+#include "HeadlessScene.h"
+
+#include "../src/Model.h"
+
+#include <chrono>
+#include <iostream>
+#include <glm/gtc/matrix_transform.hpp>
+
+double Seconds(const std::chrono::steady_clock::time_point& begin, const std::chrono::steady_clock::time_point& end) {
+    return std::chrono::duration<double>(end - begin).count();
+}
+
+bool HeadlessScene::AddModel(const std::filesystem::path& modelPath, const std::vector<std::filesystem::path>& animPaths) {
+    HeadlessInstance instance;
+    instance.m_model = std::make_shared<Model>();
+    instance.m_model->m_pipelinedPhysics = m_pipelinedPhysics;
+    instance.m_model->m_fastPhysicsWarmUp = m_fastPhysicsWarmUp;
+    if (!instance.m_model->Load(modelPath, {})) {
+        std::cout << "Failed to load pmx file.\n";
+        return false;
+    }
+    instance.m_model->InitializeAnimation();
+    instance.m_anim = std::make_unique<Animation>();
+    instance.m_anim->m_model = instance.m_model;
+    for (const auto& animPath : animPaths) {
+        VMDReader vmd;
+        if (!vmd.ReadFile(animPath) || !instance.m_anim->Add(vmd)) {
+            std::cout << "Failed to read VMD file.\n";
+            return false;
+        }
+    }
+    instance.m_anim->SyncPhysics(0.0f);
+    m_instances.emplace_back(std::move(instance));
+    return true;
+}
+
+bool HeadlessScene::LoadCameraAnim(const std::filesystem::path& cameraPath) {
+    m_cameraAnim.reset();
+    VMDReader vmd;
+    if (!vmd.ReadFile(cameraPath) || vmd.m_cameras.empty())
+        return false;
+    auto cameraAnim = std::make_unique<CameraAnimation>();
+    if (!cameraAnim->Create(vmd))
+        return false;
+    m_cameraAnim = std::move(cameraAnim);
+    return true;
+}
+
+HeadlessStageTimes HeadlessScene::Run() {
+    HeadlessStageTimes total;
+    for (int frame = 0; frame < m_frameCount; frame++) {
+        const float animTime = static_cast<float>(frame) * m_timeStep;
+        const auto frameStart = std::chrono::steady_clock::now();
+        UpdateCamera(animTime);
+        const auto animationStart = std::chrono::steady_clock::now();
+        UpdateAnimation(animTime);
+        const auto skinningStart = std::chrono::steady_clock::now();
+        for (const auto& instance : m_instances)
+            instance.m_model->Update();
+        const auto frameEnd = std::chrono::steady_clock::now();
+        total.m_camera += Seconds(frameStart, animationStart);
+        total.m_animation += Seconds(animationStart, skinningStart);
+        total.m_skinning += Seconds(skinningStart, frameEnd);
+        total.m_frame += Seconds(frameStart, frameEnd);
+        for (const auto& instance : m_instances) {
+            const auto& stats = instance.m_model->m_physicsStats;
+            total.m_ik += instance.m_model->GetIkSolverTime();
+            total.m_physicsStep += stats.m_stepTime;
+            total.m_physicsWait += stats.m_waitTime;
+            total.m_physicsWriteBack += stats.m_writeBackTime;
+        }
+    }
+    for (auto& instance : m_instances) {
+        if (instance.m_updatePending)
+            instance.m_model->EndAllAnimation(m_timeStep);
+        instance.m_updatePending = false;
+    }
+    return total;
+}
+
+void HeadlessScene::Clear() {
+    m_instances.clear();
+    m_cameraAnim.reset();
+}
+
+void HeadlessScene::UpdateCamera(const float animTime) {
+    Camera camera;
+    if (m_cameraAnim) {
+        m_cameraAnim->Evaluate(animTime * 30.0f);
+        camera = m_cameraAnim->m_camera;
+    }
+    m_viewMat = camera.GetViewMatrix();
+    m_projMat = glm::perspectiveFovRH(camera.m_fov, 1280.0f, 720.0f, 1.0f, 10000.0f);
+}
+
+void HeadlessScene::UpdateAnimation(const float animTime) {
+    for (auto& instance : m_instances) {
+        const auto& model = instance.m_model;
+        if (instance.m_updatePending)
+            model->EndAllAnimation(m_timeStep);
+        instance.m_updatePending = false;
+        model->SelectPhysicsLod(m_viewMat, m_projMat);
+        if (!m_pipelinedPhysics) {
+            model->BeginAnimation();
+            model->UpdateAllAnimation(instance.m_anim.get(), animTime * 30.0f, m_timeStep);
+            continue;
+        }
+        model->SaveDrawState();
+        model->BeginAnimation();
+        model->BeginAllAnimation(instance.m_anim.get(), animTime * 30.0f);
+        model->StepPhysics(m_timeStep);
+        instance.m_updatePending = true;
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "../src/Animation.h"
+
+class Model;
+
+struct HeadlessInstance {
+    std::shared_ptr<Model>      m_model;
+    std::unique_ptr<Animation>  m_anim;
+    bool                        m_updatePending = false;
+};
+
+struct HeadlessStageTimes {
+    double  m_camera = 0.0;
+    double  m_animation = 0.0;
+    double  m_ik = 0.0;
+    double  m_physicsStep = 0.0;
+    double  m_physicsWait = 0.0;
+    double  m_physicsWriteBack = 0.0;
+    double  m_skinning = 0.0;
+    double  m_frame = 0.0;
+};
+
+struct HeadlessScene {
+    std::vector<HeadlessInstance>       m_instances;
+    std::unique_ptr<CameraAnimation>    m_cameraAnim;
+    glm::mat4   m_viewMat = glm::mat4(1);
+    glm::mat4   m_projMat = glm::mat4(1);
+    int         m_frameCount = 600;
+    float       m_timeStep = 1.0f / 60.0f;
+    bool        m_pipelinedPhysics = false;
+    bool        m_fastPhysicsWarmUp = true;
+
+    bool AddModel(const std::filesystem::path& modelPath, const std::vector<std::filesystem::path>& animPaths);
+    bool LoadCameraAnim(const std::filesystem::path& cameraPath);
+    HeadlessStageTimes Run();
+    void Clear();
+
+private:
+    void UpdateCamera(float animTime);
+    void UpdateAnimation(float animTime);
+};
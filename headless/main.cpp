@@ -0,0 +1,79 @@
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+#include "HeadlessScene.h"
+#include "../src/Model.h"
+
+struct HeadlessModelConfig {
+    std::filesystem::path               m_modelPath;
+    std::vector<std::filesystem::path>  m_animPaths;
+};
+
+template <class T>
+bool ParseNumber(const char* text, T& value) {
+    const char* end = text + std::strlen(text);
+    const auto [ptr, ec] = std::from_chars(text, end, value);
+    return ec == std::errc() && ptr == end;
+}
+
+int PrintUsage() {
+    std::cout << "Usage: PmxModHeadless [--frames <count>] [--fps <fps>] [--camera <camera.vmd>] [--pipelined] <model.pmx> [motion.vmd...]...\n";
+    return 1;
+}
+
+int main(const int argc, char** argv) {
+    HeadlessScene scene;
+    std::filesystem::path cameraPath;
+    std::vector<HeadlessModelConfig> modelConfigs;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) {
+            if (!ParseNumber(argv[++i], scene.m_frameCount) || scene.m_frameCount <= 0)
+                return PrintUsage();
+        } else if (arg == "--fps" && i + 1 < argc) {
+            float fps = 0.0f;
+            if (!ParseNumber(argv[++i], fps) || !(fps > 0.0f))
+                return PrintUsage();
+            scene.m_timeStep = 1.0f / fps;
+        } else if (arg == "--camera" && i + 1 < argc)
+            cameraPath = argv[++i];
+        else if (arg == "--pipelined")
+            scene.m_pipelinedPhysics = true;
+        else if (std::filesystem::path(arg).extension() == ".pmx")
+            modelConfigs.push_back({ arg, {} });
+        else if (!modelConfigs.empty() && arg.rfind("--", 0) != 0)
+            modelConfigs.back().m_animPaths.emplace_back(arg);
+        else
+            return PrintUsage();
+    }
+    if (modelConfigs.empty())
+        return PrintUsage();
+    const auto loadStart = std::chrono::steady_clock::now();
+    if (!cameraPath.empty() && !scene.LoadCameraAnim(cameraPath))
+        std::cout << "Failed to create VMDCameraAnimation.\n";
+    for (const auto& [modelPath, animPaths] : modelConfigs) {
+        if (!scene.AddModel(modelPath, animPaths)) {
+            std::cout << "Failed to run.\n";
+            return 1;
+        }
+    }
+    const double loadSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+    const HeadlessStageTimes total = scene.Run();
+    const double scale = 1000.0 / scene.m_frameCount;
+    std::cout << "Headless " << scene.m_instances.size() << " models " << scene.m_frameCount << " frames"
+        << " step " << scene.m_timeStep * 1000.0f << " ms load " << loadSec * 1000.0 << " ms\n"
+        << "  camera " << total.m_camera * scale << " ms\n"
+        << "  animation " << total.m_animation * scale << " ms\n"
+        << "    ik " << total.m_ik * scale << " ms\n"
+        << "    physics step " << total.m_physicsStep * scale << " ms\n"
+        << "    physics wait " << total.m_physicsWait * scale << " ms\n"
+        << "    physics write back " << total.m_physicsWriteBack * scale << " ms\n"
+        << "  skinning " << total.m_skinning * scale << " ms\n"
+        << "  frame " << total.m_frame * scale << " ms\n";
+    for (const auto& instance : scene.m_instances)
+        instance.m_model->LogPhysicsStats();
+    scene.Clear();
+    return 0;
+}
@@ -1,8 +1,12 @@
-﻿#include <iostream>
+﻿#include <cwchar>
+#include <iostream>
+#include <shellapi.h>
 #include <shobjidl.h>
 
+#include "viewer/Benchmark.h"
 #include "viewer/DX11Viewer.h"
 #include "viewer/GLFWViewer.h"
+#include "src/Model.h"
 
 inline bool PickFilesWin(
 	std::vector<std::filesystem::path>& out,
@@ -159,7 +163,76 @@ static SceneConfig BuildTestSceneConfig3() {
 	return cfg;
 }
 
+static bool ReadCommandLine(std::vector<std::filesystem::path>& args) {
+	args.clear();
+	int argc = 0;
+	LPWSTR* argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+	if (!argv)
+		return false;
+	for (int i = 1; i < argc; i++)
+		args.emplace_back(argv[i]);
+	LocalFree(argv);
+	return true;
+}
+
+static bool ParseFloat(const std::wstring& text, float& value) {
+	wchar_t* end = nullptr;
+	value = std::wcstof(text.c_str(), &end);
+	return end != text.c_str() && *end == L'\0';
+}
+
+static int BakePhysics(const std::vector<std::filesystem::path>& args) {
+	constexpr auto usage = "Usage: PmxMod --bake <model.pmx> <output.track> [--fps <fps>] [motion.vmd...]\n";
+	if (args.size() < 3) {
+		std::cout << usage;
+		return 1;
+	}
+	float fps = 30.0f;
+	std::vector<std::filesystem::path> vmdPaths;
+	for (size_t i = 3; i < args.size(); i++) {
+		if (args[i] == L"--fps" && i + 1 < args.size()) {
+			if (!ParseFloat(args[++i].wstring(), fps) || !(fps > 0.0f)) {
+				std::cout << usage;
+				return 1;
+			}
+		} else
+			vmdPaths.push_back(args[i]);
+	}
+	const SceneConfig defaults;
+	const auto model = std::make_shared<Model>();
+	model->m_fixedTimeStepPhysics = defaults.m_fixedTimeStepPhysics;
+	model->m_fastPhysicsWarmUp = defaults.m_fastPhysicsWarmUp;
+	if (!model->Load(args[1], {})) {
+		std::cout << "Failed to load pmx file.\n";
+		return 1;
+	}
+	model->InitializeAnimation();
+	Animation anim;
+	anim.m_model = model;
+	for (const auto& vmdPath : vmdPaths) {
+		VMDReader vmd;
+		if (!vmd.ReadFile(vmdPath.c_str()) || !anim.Add(vmd)) {
+			std::cout << "Failed to read VMD file.\n";
+			return 1;
+		}
+	}
+	const auto start = std::chrono::steady_clock::now();
+	PhysicsTrack track;
+	track.m_key = PhysicsCache::MakeKey(*model, args[1], vmdPaths);
+	if (!track.Bake(anim, fps) || !track.Save(args[2])) {
+		std::cout << "Failed to bake physics track.\n";
+		return 1;
+	}
+	const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Baked " << track.m_frameCount << " frames of " << track.m_nodeIndices.size()
+		<< " bones in " << sec << " s\n";
+	return 0;
+}
+
 int main() {
+	std::vector<std::filesystem::path> args;
+	if (ReadCommandLine(args) && !args.empty() && args[0] == L"--bake")
+		return BakePhysics(args);
 	constexpr COMDLG_FILTERSPEC kModelFilters[]  = { {L"PMX Model", L"*.pmx"} };
 	constexpr COMDLG_FILTERSPEC kVMDFilters[]    = { {L"VMD Motion/Camera", L"*.vmd"} };
 	constexpr COMDLG_FILTERSPEC kMusicFilters[]  = { {L"Audio", L"*.wav;*.mp3;*.ogg;*.flac"} };
@@ -208,6 +281,34 @@ int main() {
 	}
 	int engineType;
 	std::cin >> engineType;
+	if (engineType == 2) {
+		std::vector<PhysicsBenchmarkResult> results;
+		if (!Benchmark().RunPhysics(cfg, results)) {
+			std::cout << "Failed to run benchmark.\n";
+			return 1;
+		}
+		return 0;
+	}
+	if (engineType == 3) {
+		Benchmark().RunOverlapFilter();
+		return 0;
+	}
+	if (engineType == 4) {
+		std::vector<JointBenchmarkResult> results;
+		if (!Benchmark().RunJoints(cfg, results)) {
+			std::cout << "Failed to run benchmark.\n";
+			return 1;
+		}
+		return 0;
+	}
+	if (engineType == 5) {
+		std::vector<WarmUpBenchmarkResult> results;
+		if (!Benchmark().RunWarmUp(cfg, results)) {
+			std::cout << "Failed to run benchmark.\n";
+			return 1;
+		}
+		return 0;
+	}
 	std::unique_ptr<Viewer> viewer;
 	if (engineType == 0)
 		viewer = std::make_unique<GLFWViewer>();
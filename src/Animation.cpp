@@ -5,9 +5,14 @@
 
 #include <ranges>
 
+#ifndef _WIN32
+#include <iconv.h>
+#endif
+
 std::string SjisToUtf8(const char* sjis) {
 	if (!sjis)
 		return {};
+#ifdef _WIN32
 	const int need = MultiByteToWideChar(
 		932, MB_ERR_INVALID_CHARS,
 		sjis, -1,
@@ -24,6 +29,29 @@ std::string SjisToUtf8(const char* sjis) {
 	if (!w.empty() && w.back() == L'\0')
 		w.pop_back();
 	return Util::WStringToUtf8(w);
+#else
+	const iconv_t cd = iconv_open("UTF-8", "CP932");
+	if (cd == reinterpret_cast<iconv_t>(-1))
+		return {};
+	std::string in(sjis);
+	std::string out(in.size() * 3, '\0');
+	char* inPtr = in.data();
+	size_t inLeft = in.size();
+	char* outPtr = out.data();
+	size_t outLeft = out.size();
+	const size_t result = iconv(cd, &inPtr, &inLeft, &outPtr, &outLeft);
+	iconv_close(cd);
+	if (result == static_cast<size_t>(-1))
+		return {};
+	out.resize(out.size() - outLeft);
+	return out;
+#endif
+}
+
+glm::mat4 InterpolateTransform(const glm::mat4& from, const glm::mat4& to, const float weight) {
+	glm::mat4 m = glm::mat4_cast(glm::slerp(glm::quat_cast(from), glm::quat_cast(to), weight));
+	m[3] = glm::vec4(glm::mix(glm::vec3(from[3]), glm::vec3(to[3]), weight), 1);
+	return m;
 }
 
 void SetBezier(std::pair<glm::vec2, glm::vec2>& bezier, const int x0, const int x1, const int y0, const int y1) {
@@ -82,7 +110,7 @@ bool Animation::Add(const VMDReader& vmd) {
 		auto& [first, second] = findIt->second;
 		if (inserted) {
 			auto it = std::ranges::find(m_model->m_nodes, nodeName, &Node::m_name);
-			first = it != m_model->m_nodes.end() ? it->get() : nullptr;
+			first = it != m_model->m_nodes.end() ? &*it : nullptr;
 		}
 		if (!first)
 			continue;
@@ -151,12 +179,13 @@ void Animation::Destroy() {
 }
 
 void Animation::Evaluate(const float t, const float animWeight) const {
+	auto& pose = m_model->m_skeleton.m_pose;
 	for (const auto& [node, keys]: m_nodes) {
 		if (!node)
 			continue;
 		if (keys.empty()) {
-			node->m_animTranslate = glm::vec3(0);
-			node->m_animRotate = glm::quat(1, 0, 0, 0);
+			pose.m_animTranslates[node->m_index] = glm::vec3(0);
+			pose.m_animRotates[node->m_index] = glm::quat(1, 0, 0, 0);
 			continue;
 		}
 		const auto it = std::ranges::upper_bound(keys, t, std::less{},
@@ -182,8 +211,8 @@ void Animation::Evaluate(const float t, const float animWeight) const {
 			vt = glm::mix(prev.m_translate, m_translate, glm::vec3(tx_y, ty_y, tz_y));
 			q  = glm::slerp(prev.m_rotate,   m_rotate,   rot_y);
 		}
-		node->m_animTranslate = animWeight != 1.0f ? glm::mix(node->m_baseAnimTranslate, vt, animWeight) : vt;
-		node->m_animRotate = animWeight != 1.0f ? glm::slerp(node->m_baseAnimRotate, q, animWeight) : q;
+		pose.m_animTranslates[node->m_index] = animWeight != 1.0f ? glm::mix(node->m_baseAnimTranslate, vt, animWeight) : vt;
+		pose.m_animRotates[node->m_index] = animWeight != 1.0f ? glm::slerp(node->m_baseAnimRotate, q, animWeight) : q;
 	}
 	for (const auto& [ikSolver, keys] : m_iks) {
 		if (!ikSolver)
@@ -215,8 +244,29 @@ void Animation::Evaluate(const float t, const float animWeight) const {
 	}
 }
 
+int32_t Animation::GetMaxFrame() const {
+	int32_t maxFrame = 0;
+	for (const auto& keys : m_nodes | std::views::values) {
+		if (!keys.empty())
+			maxFrame = glm::max(maxFrame, keys.back().m_time);
+	}
+	for (const auto& keys : m_iks | std::views::values) {
+		if (!keys.empty())
+			maxFrame = glm::max(maxFrame, keys.back().m_time);
+	}
+	for (const auto& keys : m_morphs | std::views::values) {
+		if (!keys.empty())
+			maxFrame = glm::max(maxFrame, keys.back().m_time);
+	}
+	return maxFrame;
+}
+
 void Animation::SyncPhysics(const float t) const {
 	m_model->SaveBaseAnimation();
+	if (m_model->m_fastPhysicsWarmUp) {
+		WarmUpPhysics(t);
+		return;
+	}
 	for (int i = 0; i < 30; i++) {
 		m_model->BeginAnimation();
 		Evaluate(t, static_cast<float>(1 + i) / 30.0f);
@@ -227,6 +277,64 @@ void Animation::SyncPhysics(const float t) const {
 	}
 }
 
+void Animation::WarmUpPhysics(const float t) const {
+	auto& pose = m_model->m_skeleton.m_pose;
+	const std::vector<glm::mat4> baseGlobals = pose.m_globals;
+	m_model->BeginAnimation();
+	Evaluate(t);
+	m_model->UpdateMorphAnimation();
+	m_model->UpdateNodeAnimation(false);
+	m_model->UpdateNodeAnimation(true);
+	const std::vector<glm::mat4> targetLocals = pose.m_locals;
+	const std::vector<glm::mat4> targetGlobals = pose.m_globals;
+	for (int i = 0; i < 30; i++) {
+		const float weight = static_cast<float>(1 + i) / 30.0f;
+		pose.m_locals = targetLocals;
+		for (size_t j = 0; j < targetGlobals.size(); j++)
+			pose.m_globals[j] = InterpolateTransform(baseGlobals[j], targetGlobals[j], weight);
+		m_model->UpdatePhysicsAnimation(1.0f / 30.0f);
+	}
+	m_model->UpdateNodeAnimation(true);
+}
+
+bool Animation::RestorePhysics(const float t, const PhysicsSnapshot& snapshot) const {
+	m_model->BeginAnimation();
+	Evaluate(t);
+	m_model->UpdateMorphAnimation();
+	m_model->UpdateNodeAnimation(false);
+	if (!m_model->RestorePhysicsSnapshot(snapshot))
+		return false;
+	m_model->UpdateNodeAnimation(true);
+	return true;
+}
+
+void Animation::ResetPhysics(const float t) const {
+	m_model->BeginAnimation();
+	Evaluate(t);
+	m_model->UpdateMorphAnimation();
+	m_model->UpdateNodeAnimation(false);
+	m_model->ResetPhysics();
+	m_model->UpdateNodeAnimation(true);
+}
+
+void Animation::BeginResetPhysics(const float t) const {
+	m_model->BeginAnimation();
+	Evaluate(t);
+	m_model->UpdateMorphAnimation();
+	m_model->UpdateNodeAnimation(false);
+	m_model->BeginResetPhysics();
+}
+
+void Animation::PreRollPhysics(const float begin, const float end) const {
+	float frame = begin;
+	while (frame < end) {
+		const float next = glm::min(frame + 1.0f, end);
+		m_model->BeginAnimation();
+		m_model->UpdateAllAnimation(this, next, (next - frame) / 30.0f);
+		frame = next;
+	}
+}
+
 glm::mat4 Camera::GetViewMatrix() const {
 	glm::mat4 view(1.0f);
 	view = glm::translate(view, glm::vec3(0, 0, -m_distance));
@@ -7,6 +7,7 @@
 struct IkSolver;
 struct Morph;
 struct Node;
+struct PhysicsSnapshot;
 class Model;
 
 struct NodeAnimationKey {
@@ -40,7 +41,13 @@ struct Animation {
 	bool Add(const VMDReader& vmd);
 	void Destroy();
 	void Evaluate(float t, float animWeight = 1.0f) const;
+	int32_t GetMaxFrame() const;
 	void SyncPhysics(float t) const;
+	void WarmUpPhysics(float t) const;
+	bool RestorePhysics(float t, const PhysicsSnapshot& snapshot) const;
+	void ResetPhysics(float t) const;
+	void BeginResetPhysics(float t) const;
+	void PreRollPhysics(float begin, float end) const;
 };
 
 struct Camera {
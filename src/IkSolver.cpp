@@ -1,6 +1,10 @@
 ﻿#include "IkSolver.h"
 
 #include "Node.h"
+#include "Skeleton.h"
+
+#include <algorithm>
+#include <chrono>
 
 float NormalizeAngle(float angle) {
 	angle = std::fmod(angle, glm::two_pi<float>());
@@ -18,6 +22,13 @@ float DiffAngle(const float a, const float b) {
 	return diff;
 }
 
+glm::mat4 InverseRigid(const glm::mat4& m) {
+	const glm::mat3 rot = glm::transpose(glm::mat3(m));
+	glm::mat4 inv(rot);
+	inv[3] = glm::vec4(-(rot * glm::vec3(m[3])), 1);
+	return inv;
+}
+
 glm::vec3 Decompose(const glm::mat3& m, const glm::vec3& before) {
 	glm::vec3 r;
 	const float sy = -m[0][2];
@@ -76,39 +87,327 @@ glm::vec3 Decompose(const glm::mat3& m, const glm::vec3& before) {
 	return r;
 }
 
+void IkSolverStats::Reset() {
+	*this = IkSolverStats();
+}
+
 void IkSolver::Solve() {
-	if (!m_enable)
+	if (!m_enable) {
+		m_warmValid = false;
 		return;
-	for (auto &chain: m_chains) {
-		chain.m_prevAngle = glm::vec3(0);
-		chain.m_node->m_ikRotate = glm::quat(1, 0, 0, 0);
-		chain.m_planeModeAngle = 0;
-		chain.m_node->UpdateLocalTransform();
-		chain.m_node->UpdateGlobalTransform();
 	}
+	const auto start = std::chrono::steady_clock::now();
+	m_stats.m_rollback = false;
+	m_stats.m_planeCount = 0;
+	const bool warm = m_warmStart && m_warmValid;
+	if (warm)
+		SeedChains();
+	else
+		ResetChains();
+	uint32_t iterations = 0;
+	if (!warm || GetError() >= m_tolerance) {
+		switch (m_type) {
+			case IkSolverType::TwoBone:
+				iterations = SolveTwoBone();
+				break;
+			case IkSolverType::FABRIK:
+				iterations = SolveFABRIK();
+				break;
+			default:
+				iterations = SolveCCD(warm);
+				break;
+		}
+	}
+	m_error = GetError();
+	const IkSolverStats stats = m_stats;
+	if (m_compareWithCCD && m_type != IkSolverType::CCD) {
+		std::vector<glm::quat> solvedRotates;
+		solvedRotates.reserve(m_chains.size());
+		for (const auto &chain: m_chains)
+			solvedRotates.push_back(chain.m_node->m_ikRotate);
+		ResetChains();
+		SolveCCD(false);
+		m_ccdError = GetError();
+		for (size_t i = 0; i < m_chains.size(); i++) {
+			m_chains[i].m_node->m_ikRotate = solvedRotates[i];
+			UpdateChainTransform(m_chains[i]);
+		}
+	}
+	for (auto &chain: m_chains)
+		chain.m_warmIKRot = chain.m_node->m_ikRotate;
+	m_warmValid = true;
+	if (m_chainLocal)
+		m_skeleton->UpdateSubtreeTransform(m_chainPath.front());
+	m_stats = stats;
+	m_stats.m_iterations = iterations;
+	m_stats.m_iterateCount = m_iterateCount;
+	m_stats.m_error = m_error;
+	m_stats.m_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	m_stats.m_totalIterations += iterations;
+	m_stats.m_solveCount++;
+	m_stats.m_rollbackCount += m_stats.m_rollback ? 1 : 0;
+	m_stats.m_totalPlaneCount += m_stats.m_planeCount;
+	m_stats.m_totalTime += m_stats.m_time;
+}
+
+void IkSolver::ResetWarmStart() {
+	m_warmValid = false;
+}
+
+uint32_t IkSolver::SolveCCD(const bool warm) {
 	float maxDist = std::numeric_limits<float>::max();
-	for (uint32_t i = 0; i < m_iterateCount; i++) {
-		SolveCore(i);
-		auto targetPos = glm::vec3(m_ikTarget->m_global[3]);
-		auto ikPos = glm::vec3(m_ikNode->m_global[3]);
-		const float dist = glm::length(targetPos - ikPos);
+	if (warm) {
+		maxDist = GetError();
+		for (auto &chain: m_chains)
+			chain.m_saveIKRot = chain.m_node->m_ikRotate;
+	}
+	uint32_t i = 0;
+	while (i < m_iterateCount) {
+		SolveCore(i++);
+		const float dist = GetError();
 		if (dist < maxDist) {
 			maxDist = dist;
 			for (auto &chain: m_chains)
 				chain.m_saveIKRot = chain.m_node->m_ikRotate;
+			if (warm && dist < m_tolerance)
+				break;
 		} else {
 			for (const auto &chain: m_chains) {
 				chain.m_node->m_ikRotate = chain.m_saveIKRot;
-				chain.m_node->UpdateLocalTransform();
-				chain.m_node->UpdateGlobalTransform();
+				UpdateChainTransform(chain);
 			}
+			m_stats.m_rollback = true;
 			break;
 		}
 	}
+	return i;
+}
+
+uint32_t IkSolver::SolveTwoBone() {
+	auto &mid = m_chains[0];
+	auto &root = m_chains[1];
+	Node *midNode = mid.m_node;
+	Node *rootNode = root.m_node;
+	const auto axis = glm::vec3(glm::mat3(1)[m_twoBoneAxis]);
+	const auto ikPos = glm::vec3(m_ikNode->GetGlobal()[3]);
+	const auto rootPos = glm::vec3(rootNode->GetGlobal()[3]);
+	const auto targetPos = glm::vec3(m_ikTarget->GetGlobal()[3]);
+	const glm::mat4 parentGlobal = midNode->m_parent ? midNode->m_parent->GetGlobal() : glm::mat4(1);
+	const glm::mat4 invMidFrame = InverseRigid(glm::translate(parentGlobal, glm::vec3(midNode->GetLocal()[3])));
+	const auto rootVec = glm::vec3(invMidFrame * glm::vec4(rootPos, 1));
+	const auto targetVec = glm::vec3(InverseRigid(midNode->GetGlobal()) * glm::vec4(targetPos, 1));
+	const float rootAxial = glm::dot(rootVec, axis);
+	const float targetAxial = glm::dot(targetVec, axis);
+	const glm::vec3 rootPerp = rootVec - axis * rootAxial;
+	const glm::vec3 targetPerp = targetVec - axis * targetAxial;
+	const float p = glm::dot(rootPerp, targetPerp);
+	const float q = glm::dot(rootPerp, glm::cross(axis, targetPerp));
+	const float m = std::sqrt(p * p + q * q);
+	const float minAngle = mid.m_limitMin[m_twoBoneAxis];
+	const float maxAngle = mid.m_limitMax[m_twoBoneAxis];
+	float angle = glm::clamp(mid.m_planeModeAngle, minAngle, maxAngle);
+	if (m > 1.0e-6f) {
+		const float dist = glm::length(ikPos - rootPos);
+		const float k = ((glm::dot(rootVec, rootVec) + glm::dot(targetVec, targetVec) - dist * dist) * 0.5f
+			- rootAxial * targetAxial) / m;
+		const float phase = std::atan2(q, p);
+		const float bend = std::acos(glm::clamp(k, -1.0f, 1.0f));
+		auto fit = [&](float candidate) {
+			for (const float offset : { 0.0f, glm::two_pi<float>(), -glm::two_pi<float>() }) {
+				if (candidate + offset >= minAngle && candidate + offset <= maxAngle)
+					return candidate + offset;
+			}
+			return glm::clamp(candidate, minAngle, maxAngle);
+		};
+		const float angle1 = fit(phase + bend);
+		const float angle2 = fit(phase - bend);
+		const float err1 = std::abs(std::cos(angle1 - phase) - k);
+		const float err2 = std::abs(std::cos(angle2 - phase) - k);
+		angle = err1 <= err2 ? angle1 : angle2;
+	}
+	mid.m_planeModeAngle = angle;
+	midNode->m_ikRotate = glm::rotate(glm::quat(1, 0, 0, 0), angle, axis) *
+		glm::inverse(midNode->GetAnimRotate() * midNode->m_rotate);
+	UpdateChainTransform(mid);
+	const glm::mat4 invRoot = InverseRigid(rootNode->GetGlobal());
+	const auto rootTargetVec = glm::vec3(invRoot * glm::vec4(glm::vec3(m_ikTarget->GetGlobal()[3]), 1));
+	const auto rootIkVec = glm::vec3(invRoot * glm::vec4(ikPos, 1));
+	if (glm::length(rootTargetVec) < 1.0e-6f || glm::length(rootIkVec) < 1.0e-6f)
+		return 1;
+	const float dot = glm::clamp(glm::dot(glm::normalize(rootTargetVec), glm::normalize(rootIkVec)), -1.0f, 1.0f);
+	const float rootAngle = std::acos(dot);
+	if (rootAngle < 1.0e-6f)
+		return 1;
+	const auto cross = glm::normalize(glm::cross(rootTargetVec, rootIkVec));
+	const auto rot = glm::rotate(glm::quat(1, 0, 0, 0), rootAngle, cross);
+	const auto animRot = rootNode->GetAnimRotate() * rootNode->m_rotate;
+	rootNode->m_ikRotate = rootNode->m_ikRotate * animRot * rot * glm::inverse(animRot);
+	UpdateChainTransform(root);
+	return 1;
+}
+
+uint32_t IkSolver::SolveFABRIK() {
+	constexpr float Tolerance = 1.0e-4f;
+	const size_t jointCount = m_chains.size();
+	std::vector<const IKChain*> joints;
+	joints.reserve(jointCount);
+	for (auto it = m_chains.rbegin(); it != m_chains.rend(); ++it)
+		joints.push_back(&*it);
+	std::vector<glm::vec3> positions(jointCount + 1);
+	std::vector<float> lengths(jointCount);
+	for (size_t i = 0; i < jointCount; i++)
+		positions[i] = glm::vec3(joints[i]->m_node->GetGlobal()[3]);
+	positions[jointCount] = glm::vec3(m_ikTarget->GetGlobal()[3]);
+	float totalLength = 0;
+	for (size_t i = 0; i < jointCount; i++) {
+		lengths[i] = glm::length(positions[i + 1] - positions[i]);
+		totalLength += lengths[i];
+	}
+	const auto ikPos = glm::vec3(m_ikNode->GetGlobal()[3]);
+	const glm::vec3 rootPos = positions[0];
+	auto direction = [](const glm::vec3 &v) {
+		const float len = glm::length(v);
+		return len > 1.0e-6f ? v / len : glm::vec3(0);
+	};
+	uint32_t iterations = 1;
+	if (glm::length(ikPos - rootPos) >= totalLength) {
+		const glm::vec3 dir = direction(ikPos - rootPos);
+		for (size_t i = 0; i < jointCount; i++)
+			positions[i + 1] = positions[i] + dir * lengths[i];
+	} else {
+		for (iterations = 0; iterations < m_iterateCount;) {
+			iterations++;
+			positions[jointCount] = ikPos;
+			for (size_t i = jointCount; i-- > 0;)
+				positions[i] = positions[i + 1] + direction(positions[i] - positions[i + 1]) * lengths[i];
+			positions[0] = rootPos;
+			for (size_t i = 0; i < jointCount; i++)
+				positions[i + 1] = positions[i] + direction(positions[i + 1] - positions[i]) * lengths[i];
+			if (glm::length(positions[jointCount] - ikPos) < Tolerance)
+				break;
+		}
+	}
+	const float maxAngle = m_limitAngle * static_cast<float>(m_iterateCount);
+	for (size_t i = 0; i < jointCount; i++) {
+		Node *node = joints[i]->m_node;
+		const Node *next = i + 1 < jointCount ? joints[i + 1]->m_node : m_ikTarget;
+		const glm::mat4 invNode = InverseRigid(node->GetGlobal());
+		const auto curVec = glm::vec3(invNode * glm::vec4(glm::vec3(next->GetGlobal()[3]), 1));
+		const auto newVec = glm::vec3(invNode * glm::vec4(positions[i + 1], 1));
+		if (glm::length(curVec) < 1.0e-6f || glm::length(newVec) < 1.0e-6f)
+			continue;
+		const float dot = glm::clamp(glm::dot(glm::normalize(curVec), glm::normalize(newVec)), -1.0f, 1.0f);
+		const float angle = glm::min(std::acos(dot), maxAngle);
+		if (angle < 1.0e-6f)
+			continue;
+		const auto cross = glm::normalize(glm::cross(curVec, newVec));
+		const auto rot = glm::rotate(glm::quat(1, 0, 0, 0), angle, cross);
+		const auto animRot = node->GetAnimRotate() * node->m_rotate;
+		node->m_ikRotate = node->m_ikRotate * animRot * rot * glm::inverse(animRot);
+		UpdateChainTransform(*joints[i]);
+	}
+	return iterations;
+}
+
+void IkSolver::SetupSolverType() {
+	m_type = IkSolverType::CCD;
+	if (!m_chainLocal)
+		return;
+	const auto singleAxis = [](const IKChain &chain) {
+		int axisIndex = -1;
+		for (int i = 0; i < 3; i++) {
+			if (chain.m_limitMin[i] == 0 && chain.m_limitMax[i] == 0)
+				continue;
+			if (axisIndex != -1)
+				return -1;
+			axisIndex = i;
+		}
+		return axisIndex;
+	};
+	if (m_chains.size() == 2) {
+		const auto &mid = m_chains[0];
+		const auto &root = m_chains[1];
+		if (root.m_pathIndex == 0 && mid.m_pathIndex == 1 && mid.m_node != m_ikTarget &&
+		    mid.m_enableAxisLimit && !root.m_enableAxisLimit) {
+			if (const int axisIndex = singleAxis(mid); axisIndex != -1) {
+				m_twoBoneAxis = axisIndex;
+				m_type = IkSolverType::TwoBone;
+			}
+		}
+		return;
+	}
+	if (m_chains.size() < 3)
+		return;
+	for (size_t i = 0; i < m_chains.size(); i++) {
+		const auto &chain = m_chains[i];
+		if (chain.m_enableAxisLimit || chain.m_node == m_ikTarget)
+			return;
+		if (i > 0 && chain.m_pathIndex >= m_chains[i - 1].m_pathIndex)
+			return;
+	}
+	m_type = IkSolverType::FABRIK;
+}
+
+float IkSolver::GetError() const {
+	return glm::length(glm::vec3(m_ikTarget->GetGlobal()[3]) - glm::vec3(m_ikNode->GetGlobal()[3]));
+}
+
+void IkSolver::SeedChains() {
+	for (auto &chain: m_chains) {
+		chain.m_node->m_ikRotate = chain.m_warmIKRot;
+		UpdateChainTransform(chain);
+	}
+}
+
+void IkSolver::ResetChains() {
+	for (auto &chain: m_chains) {
+		chain.m_prevAngle = glm::vec3(0);
+		chain.m_node->m_ikRotate = glm::quat(1, 0, 0, 0);
+		chain.m_planeModeAngle = 0;
+		UpdateChainTransform(chain);
+	}
+}
+
+void IkSolver::SetupChainPath() {
+	m_chainPath.clear();
+	m_chainLocal = false;
+	for (Node* node = m_ikTarget; node; node = node->m_parent)
+		m_chainPath.push_back(node);
+	std::ranges::reverse(m_chainPath);
+	size_t rootIndex = m_chainPath.size();
+	for (auto& chain : m_chains) {
+		const auto it = std::ranges::find(m_chainPath, chain.m_node);
+		if (it == m_chainPath.end())
+			return;
+		chain.m_pathIndex = static_cast<size_t>(it - m_chainPath.begin());
+		rootIndex = std::min<size_t>(rootIndex, chain.m_pathIndex);
+	}
+	if (rootIndex >= m_chainPath.size())
+		return;
+	for (const Node* node = m_ikNode; node; node = node->m_parent) {
+		if (node == m_chainPath[rootIndex])
+			return;
+	}
+	m_chainPath.erase(m_chainPath.begin(), m_chainPath.begin() + static_cast<std::ptrdiff_t>(rootIndex));
+	for (auto& chain : m_chains)
+		chain.m_pathIndex -= rootIndex;
+	m_chainLocal = true;
+}
+
+void IkSolver::UpdateChainTransform(const IKChain& chain) {
+	chain.m_node->UpdateLocalTransform();
+	if (!m_chainLocal) {
+		m_skeleton->UpdateSubtreeTransform(chain.m_node);
+		return;
+	}
+	for (size_t i = chain.m_pathIndex; i < m_chainPath.size(); i++) {
+		const Node* node = m_chainPath[i];
+		node->GetGlobal() = node->m_parent ? node->m_parent->GetGlobal() * node->GetLocal() : node->GetLocal();
+	}
 }
 
 void IkSolver::SolveCore(uint32_t iteration) {
-	auto ikPos = glm::vec3(m_ikNode->m_global[3]);
+	auto ikPos = glm::vec3(m_ikNode->GetGlobal()[3]);
 	for (size_t chainIdx = 0; chainIdx < m_chains.size(); chainIdx++) {
 		auto &chain = m_chains[chainIdx];
 		Node *chainNode = chain.m_node;
@@ -134,8 +433,8 @@ void IkSolver::SolveCore(uint32_t iteration) {
 				continue;
 			}
 		}
-		auto targetPos = glm::vec3(m_ikTarget->m_global[3]);
-		auto invChain = glm::inverse(chain.m_node->m_global);
+		auto targetPos = glm::vec3(m_ikTarget->GetGlobal()[3]);
+		auto invChain = m_chainLocal ? InverseRigid(chain.m_node->GetGlobal()) : glm::inverse(chain.m_node->GetGlobal());
 		auto chainIkPos = glm::vec3(invChain * glm::vec4(ikPos, 1));
 		auto chainTargetPos = glm::vec3(invChain * glm::vec4(targetPos, 1));
 		auto chainIkVec = glm::normalize(chainIkPos);
@@ -148,7 +447,7 @@ void IkSolver::SolveCore(uint32_t iteration) {
 		angle = glm::clamp(angle, -m_limitAngle, m_limitAngle);
 		auto cross = glm::normalize(glm::cross(chainTargetVec, chainIkVec));
 		auto rot = glm::rotate(glm::quat(1, 0, 0, 0), angle, cross);
-		auto animRot = chainNode->m_animRotate * chainNode->m_rotate;
+		auto animRot = chainNode->GetAnimRotate() * chainNode->m_rotate;
 		auto chainRot = chainNode->m_ikRotate * animRot * rot;
 		if (chain.m_enableAxisLimit) {
 			auto chainRotM = glm::mat3_cast(chainRot);
@@ -165,8 +464,7 @@ void IkSolver::SolveCore(uint32_t iteration) {
 		}
 		auto ikRot = chainRot * glm::inverse(animRot);
 		chainNode->m_ikRotate = ikRot;
-		chainNode->UpdateLocalTransform();
-		chainNode->UpdateGlobalTransform();
+		UpdateChainTransform(chain);
 	}
 }
 
@@ -178,9 +476,10 @@ void IkSolver::SolvePlane(uint32_t iteration, size_t chainIdx, int RotateAxisInd
 	};
 	const glm::vec3& RotateAxis = axis[RotateAxisIndex];
 	auto &chain = m_chains[chainIdx];
-	auto ikPos = glm::vec3(m_ikNode->m_global[3]);
-	auto targetPos = glm::vec3(m_ikTarget->m_global[3]);
-	auto invChain = glm::inverse(chain.m_node->m_global);
+	m_stats.m_planeCount++;
+	auto ikPos = glm::vec3(m_ikNode->GetGlobal()[3]);
+	auto targetPos = glm::vec3(m_ikTarget->GetGlobal()[3]);
+	auto invChain = m_chainLocal ? InverseRigid(chain.m_node->GetGlobal()) : glm::inverse(chain.m_node->GetGlobal());
 	auto chainIkPos = glm::vec3(invChain * glm::vec4(ikPos, 1));
 	auto chainTargetPos = glm::vec3(invChain * glm::vec4(targetPos, 1));
 	auto chainIkVec = glm::normalize(chainIkPos);
@@ -212,8 +511,7 @@ void IkSolver::SolvePlane(uint32_t iteration, size_t chainIdx, int RotateAxisInd
 	newAngle = glm::clamp(newAngle, chain.m_limitMin[RotateAxisIndex], chain.m_limitMax[RotateAxisIndex]);
 	chain.m_planeModeAngle = newAngle;
 	auto ikRotM = glm::rotate(glm::quat(1, 0, 0, 0), newAngle, RotateAxis) *
-		glm::inverse(chain.m_node->m_animRotate * chain.m_node->m_rotate);
+		glm::inverse(chain.m_node->GetAnimRotate() * chain.m_node->m_rotate);
 	chain.m_node->m_ikRotate = ikRotM;
-	chain.m_node->UpdateLocalTransform();
-	chain.m_node->UpdateGlobalTransform();
+	UpdateChainTransform(chain);
 }
@@ -4,6 +4,13 @@
 #include <glm/gtc/quaternion.hpp>
 
 struct Node;
+struct Skeleton;
+
+enum class IkSolverType : uint8_t {
+	CCD,
+	TwoBone,
+	FABRIK
+};
 
 struct IKChain {
 	Node*		m_node;
@@ -12,19 +19,61 @@ struct IKChain {
 	glm::vec3	m_limitMin;
 	glm::vec3	m_prevAngle;
 	glm::quat	m_saveIKRot;
+	glm::quat	m_warmIKRot = glm::quat(1, 0, 0, 0);
 	float		m_planeModeAngle;
+	size_t		m_pathIndex = 0;
+};
+
+struct IkSolverStats {
+	uint32_t	m_iterations = 0;
+	uint32_t	m_iterateCount = 0;
+	float		m_error = 0;
+	bool		m_rollback = false;
+	uint32_t	m_planeCount = 0;
+	double		m_time = 0;
+	uint64_t	m_totalIterations = 0;
+	uint64_t	m_solveCount = 0;
+	uint64_t	m_rollbackCount = 0;
+	uint64_t	m_totalPlaneCount = 0;
+	double		m_totalTime = 0;
+
+	void Reset();
 };
 
 struct IkSolver {
 	std::vector<IKChain>	m_chains;
 	Node*					m_ikNode = nullptr;
 	Node*					m_ikTarget = nullptr;
+	Skeleton*				m_skeleton = nullptr;
+	std::vector<Node*>		m_chainPath;
 	uint32_t				m_iterateCount = 1;
 	float					m_limitAngle = glm::two_pi<float>();
 	bool					m_enable = true;
 	bool					m_baseAnimEnable = true;
+	bool					m_chainLocal = false;
+	IkSolverType			m_type = IkSolverType::CCD;
+	int						m_twoBoneAxis = 0;
+	bool					m_compareWithCCD = false;
+	float					m_error = 0;
+	float					m_ccdError = 0;
+	bool					m_warmStart = false;
+	bool					m_warmValid = false;
+	float					m_tolerance = 1.0e-3f;
+	IkSolverStats			m_stats;
 
 	void Solve();
+	void SetupChainPath();
+	void SetupSolverType();
+	void ResetWarmStart();
 	void SolveCore(uint32_t iteration);
 	void SolvePlane(uint32_t iteration, size_t chainIdx, int RotateAxisIndex);
+	float GetError() const;
+
+private:
+	void ResetChains();
+	void SeedChains();
+	uint32_t SolveCCD(bool warm);
+	uint32_t SolveTwoBone();
+	uint32_t SolveFABRIK();
+	void UpdateChainTransform(const IKChain& chain);
 };
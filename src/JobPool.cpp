@@ -0,0 +1,97 @@
+﻿#include "JobPool.h"
+
+#include <algorithm>
+#include <atomic>
+
+JobPool::~JobPool() {
+	Stop();
+}
+
+JobPool& JobPool::Get() {
+	static JobPool pool;
+	static std::once_flag started;
+	std::call_once(started, [] {
+		pool.Start(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	});
+	return pool;
+}
+
+void JobPool::Start(const size_t threadCount) {
+	Stop();
+	m_stop = false;
+	m_workers.reserve(threadCount);
+	for (size_t i = 0; i < threadCount; i++)
+		m_workers.emplace_back([this] { WorkerLoop(); });
+}
+
+void JobPool::Stop() {
+	{
+		std::lock_guard lock(m_mutex);
+		m_stop = true;
+	}
+	m_cv.notify_all();
+	for (auto& worker : m_workers) {
+		if (worker.joinable())
+			worker.join();
+	}
+	m_workers.clear();
+}
+
+void JobPool::ParallelFor(const size_t count, const size_t grainSize, const std::function<void(size_t, size_t)>& func) {
+	if (count == 0)
+		return;
+	const size_t grain = std::max<size_t>(grainSize, 1);
+	const size_t chunkLimit = std::min((count + grain - 1) / grain, GetThreadCount());
+	const size_t chunkSize = (count + chunkLimit - 1) / chunkLimit;
+	const size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+	if (chunkCount <= 1) {
+		func(0, count);
+		return;
+	}
+	std::atomic<size_t> remaining = chunkCount - 1;
+	{
+		std::lock_guard lock(m_mutex);
+		for (size_t i = 1; i < chunkCount; i++) {
+			const size_t begin = i * chunkSize;
+			const size_t end = std::min(count, begin + chunkSize);
+			m_jobs.emplace_back([&func, &remaining, begin, end] {
+				func(begin, end);
+				remaining.fetch_sub(1, std::memory_order_release);
+			});
+		}
+	}
+	m_cv.notify_all();
+	func(0, chunkSize);
+	while (remaining.load(std::memory_order_acquire) != 0) {
+		if (!RunPendingJob())
+			std::this_thread::yield();
+	}
+}
+
+void JobPool::WorkerLoop() {
+	while (true) {
+		std::function<void()> job;
+		{
+			std::unique_lock lock(m_mutex);
+			m_cv.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+			if (m_stop && m_jobs.empty())
+				return;
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+		job();
+	}
+}
+
+bool JobPool::RunPendingJob() {
+	std::function<void()> job;
+	{
+		std::lock_guard lock(m_mutex);
+		if (m_jobs.empty())
+			return false;
+		job = std::move(m_jobs.front());
+		m_jobs.pop_front();
+	}
+	job();
+	return true;
+}
@@ -0,0 +1,28 @@
+﻿#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct JobPool {
+	~JobPool();
+
+	std::vector<std::thread>			m_workers;
+	std::deque<std::function<void()>>	m_jobs;
+	std::mutex							m_mutex;
+	std::condition_variable				m_cv;
+	bool								m_stop = false;
+
+	static JobPool& Get();
+	size_t GetThreadCount() const { return m_workers.size() + 1; }
+	void Start(size_t threadCount);
+	void Stop();
+	void ParallelFor(size_t count, size_t grainSize, const std::function<void(size_t, size_t)>& func);
+
+private:
+	void WorkerLoop();
+	bool RunPendingJob();
+};
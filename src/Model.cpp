@@ -1,9 +1,16 @@
 ﻿#include "Model.h"
 
 #include "Animation.h"
+#include "JobPool.h"
+#include "PhysicsCache.h"
+#include "PhysicsPipeline.h"
 #include "Util.h"
 
+#include <algorithm>
+#include <chrono>
+#include <iostream>
 #include <ranges>
+#include <utility>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/quaternion.hpp>
@@ -39,24 +46,22 @@ Model::~Model() {
 
 void Model::InitializeAnimation() {
 	ClearBaseAnimation();
-	for (const auto& node : m_nodes) {
-		node->m_animTranslate = glm::vec3(0);
-		node->m_animRotate = glm::quat(1, 0, 0, 0);
-	}
 	BeginAnimation();
 	for (const auto& morph : m_morphs)
 		morph->m_weight = 0;
-	for (const auto& ikSolver : m_ikSolvers)
+	for (const auto& ikSolver : m_ikSolvers) {
 		ikSolver->m_enable = true;
+		ikSolver->ResetWarmStart();
+	}
 	UpdateNodeAnimation(false);
 	UpdateNodeAnimation(true);
 	ResetPhysics();
 }
 
-void Model::SaveBaseAnimation() const {
-	for (const auto& node : m_nodes) {
-		node->m_baseAnimTranslate = node->m_animTranslate;
-		node->m_baseAnimRotate = node->m_animRotate;
+void Model::SaveBaseAnimation() {
+	for (auto& node : m_nodes) {
+		node.m_baseAnimTranslate = node.GetAnimTranslate();
+		node.m_baseAnimRotate = node.GetAnimRotate();
 	}
 	for (const auto& morph : m_morphs)
 		morph->m_saveAnimWeight = morph->m_weight;
@@ -64,10 +69,10 @@ void Model::SaveBaseAnimation() const {
 		ikSolver->m_baseAnimEnable = ikSolver->m_enable;
 }
 
-void Model::ClearBaseAnimation() const {
-	for (const auto& node : m_nodes) {
-		node->m_baseAnimTranslate = glm::vec3(0);
-		node->m_baseAnimRotate = glm::quat(1, 0, 0, 0);
+void Model::ClearBaseAnimation() {
+	for (auto& node : m_nodes) {
+		node.m_baseAnimTranslate = glm::vec3(0);
+		node.m_baseAnimRotate = glm::quat(1, 0, 0, 0);
 	}
 	for (const auto& morph : m_morphs)
 		morph->m_saveAnimWeight = 0;
@@ -76,12 +81,10 @@ void Model::ClearBaseAnimation() const {
 }
 
 void Model::BeginAnimation() {
-	for (const auto& node : m_nodes)
-		node->BeginUpdateTransform();
-	for (const auto& node : m_nodes) {
-		node->m_animTranslate = glm::vec3(0);
-		node->m_animRotate = glm::quat(1, 0, 0, 0);
-	}
+	for (auto& node : m_nodes)
+		node.BeginUpdateTransform();
+	std::ranges::fill(m_skeleton.m_pose.m_animTranslates, glm::vec3(0));
+	std::ranges::fill(m_skeleton.m_pose.m_animRotates, glm::quat(1, 0, 0, 0));
 	std::ranges::fill(m_morphPositions, glm::vec3(0));
 	std::ranges::fill(m_morphUVs, glm::vec4(0));
 }
@@ -93,89 +96,341 @@ void Model::UpdateMorphAnimation() {
 	EndMorphMaterial();
 }
 
-void Model::UpdateNodeAnimation(const bool afterPhysicsAnim) const {
-	const auto pred = [&](const Node* node) { return node->m_isDeformAfterPhysics == afterPhysicsAnim; };
-	for (auto* node : m_sortedNodes | std::views::filter(pred))
+void Model::UpdateNodeAnimation(const bool afterPhysicsAnim) {
+	const auto& [nodes, roots, stages] = m_nodeSchedules[afterPhysicsAnim ? 1 : 0];
+	for (auto* node : nodes)
 		node->UpdateLocalTransform();
-	for (auto* node : m_sortedNodes | std::views::filter(pred)) {
-		if (!node->m_parent)
-			node->UpdateGlobalTransform();
-	}
-	for (auto* node : m_sortedNodes | std::views::filter(pred)) {
-		if (node->m_appendNode) {
-			node->UpdateAppendTransform();
-			node->UpdateGlobalTransform();
-		}
-		if (node->m_ikSolver) {
-			node->m_ikSolver->Solve();
-			node->UpdateGlobalTransform();
+	for (const auto* root : roots)
+		m_skeleton.MarkDirty(root);
+	for (const auto& [appendLevels, ikNodes] : stages) {
+		for (const auto& level : appendLevels) {
+			constexpr size_t LowerAppendCount = 128;
+			if (level.size() >= LowerAppendCount) {
+				JobPool::Get().ParallelFor(level.size(), LowerAppendCount / 2, [&level](const size_t begin, const size_t end) {
+					for (size_t i = begin; i < end; i++)
+						level[i]->UpdateAppendTransform();
+				});
+			} else {
+				for (auto* node : level)
+					node->UpdateAppendTransform();
+			}
+			for (const auto* node : level)
+				m_skeleton.MarkDirty(node);
 		}
+		if (ikNodes.empty())
+			continue;
+		m_skeleton.UpdateGlobalTransform();
+		if (ikNodes.size() > 1) {
+			JobPool::Get().ParallelFor(ikNodes.size(), 1, [&ikNodes](const size_t begin, const size_t end) {
+				for (size_t i = begin; i < end; i++)
+					ikNodes[i]->m_ikSolver->Solve();
+			});
+		} else
+			ikNodes.front()->m_ikSolver->Solve();
+		for (const auto* ikNode : ikNodes)
+			m_skeleton.MarkDirty(ikNode);
 	}
+	m_skeleton.UpdateGlobalTransform();
+}
+
+void Model::ResetPhysics() {
+	BeginResetPhysics();
+	if (!m_scenePhysics)
+		m_physics->StepReset();
+	EndResetPhysics();
 }
 
-void Model::ResetPhysics() const {
+void Model::BeginResetPhysics() {
+	WaitPhysics();
+	UpdateKinematicTransforms(false);
 	for (auto& rb : m_rigidBodies) {
 		rb->SetActivation(false);
 		rb->ResetTransform();
 	}
-	m_physics->m_world->stepSimulation(
-		1.0f / 60.0f, m_physics->m_maxSubStepCount,
-		static_cast<btScalar>(1.0f / m_physics->m_fps));
-	for (auto& rb : m_rigidBodies) {
-		rb->ReflectGlobalTransform();
-		rb->CalcLocalTransform();
-	}
-	for (const auto& node : m_nodes) {
-		if (!node->m_parent)
-			node->UpdateGlobalTransform();
-	}
+}
+
+void Model::EndResetPhysics() {
+	m_springBones.Reset();
+	EndPhysicsAnimation(0.0f);
 	for (auto& rb : m_rigidBodies)
 		rb->Reset(m_physics.get());
 }
 
-void Model::UpdatePhysicsAnimation(const float elapsed) const {
-	for (auto& rb : m_rigidBodies)
-		rb->SetActivation(true);
-	m_physics->m_world->stepSimulation(
-		elapsed, m_physics->m_maxSubStepCount,
-		static_cast<btScalar>(1.0f / m_physics->m_fps));
-	for (auto& rb : m_rigidBodies) {
-		rb->ReflectGlobalTransform();
-		rb->CalcLocalTransform();
+void Model::SetPhysicsLod(const PhysicsLod lod) {
+	if (lod == m_physicsLod)
+		return;
+	WaitPhysics();
+	if (m_physicsLod == PhysicsLod::Off) {
+		for (const auto& rb : m_rigidBodies) {
+			rb->ResetTransform();
+			rb->Reset(m_physics.get());
+		}
+		m_springBones.Reset();
+	}
+	m_physicsLod = lod;
+	m_reducedPhysicsElapsed = 0;
+}
+
+void Model::SetBakedPhysics(const bool useBakedPhysics) {
+	if (useBakedPhysics == m_useBakedPhysics)
+		return;
+	WaitPhysics();
+	m_useBakedPhysics = useBakedPhysics;
+	if (!IsBakedPhysics()) {
+		for (const auto& rb : m_rigidBodies) {
+			rb->ResetTransform();
+			rb->Reset(m_physics.get());
+		}
+		m_springBones.Reset();
+	}
+}
+
+bool Model::IsBakedPhysics() const {
+	return m_useBakedPhysics && m_physicsTrack;
+}
+
+void Model::GetPhysicsNodes(std::vector<uint32_t>& nodeIndices) const {
+	nodeIndices.clear();
+	for (const auto& rb : m_rigidBodies) {
+		if (rb->m_dynamicMotionState)
+			nodeIndices.push_back(rb->m_dynamicMotionState->m_node->m_index);
+	}
+	for (const auto* node : m_springBones.m_nodes)
+		nodeIndices.push_back(node->m_index);
+	std::ranges::sort(nodeIndices);
+	const auto [first, last] = std::ranges::unique(nodeIndices);
+	nodeIndices.erase(first, last);
+}
+
+void Model::SelectPhysicsLod(const glm::mat4& view, const glm::mat4& proj) {
+	if (!m_autoPhysicsLod || m_nodes.empty())
+		return;
+	const auto& pose = m_skeleton.m_pose;
+	const glm::vec3 center = (m_bboxMin + m_bboxMax) * 0.5f;
+	const auto viewCenter = glm::vec3(view * pose.m_globals[0] * pose.m_inverseInits[0] * glm::vec4(center, 1));
+	const float radius = glm::length(m_bboxMax - m_bboxMin) * 0.5f * glm::length(glm::vec3(view[0]));
+	const float depth = -viewCenter.z;
+	PhysicsLod lod = PhysicsLod::Full;
+	if (depth > radius) {
+		const float screenSize = radius * proj[1][1] / depth;
+		if (screenSize < m_physicsOffScreenSize)
+			lod = PhysicsLod::Off;
+		else if (screenSize < m_physicsReducedScreenSize)
+			lod = PhysicsLod::Reduced;
+	}
+	SetPhysicsLod(lod);
+}
+
+void Model::BeginPhysicsAnimation() {
+	WaitPhysics();
+	const bool active = m_physicsLod != PhysicsLod::Off && !IsBakedPhysics();
+	UpdateKinematicTransforms(active);
+	for (const auto& rb : m_rigidBodies)
+		rb->SetActivation(active);
+	if (!active || !m_physicsSleeping)
+		return;
+	bool wake = false;
+	for (const auto& rb : m_rigidBodies)
+		wake = rb->UpdateKinematicPosition(m_physicsWakeDistance) || wake;
+	if (!wake)
+		return;
+	for (const auto& rb : m_rigidBodies) {
+		if (!rb->m_rigidBody->isKinematicObject())
+			rb->m_rigidBody->activate();
+	}
+}
+
+void Model::StepPhysics(const float elapsed) {
+	if (IsBakedPhysics())
+		return;
+	if (m_physicsPipeline) {
+		m_physicsPipeline->Submit(elapsed);
+		return;
 	}
-	for (const auto& node : m_nodes) {
-		if (!node->m_parent)
-			node->UpdateGlobalTransform();
+	auto& stats = m_physicsStats;
+	stats.m_stepTime = SimulatePhysics(elapsed);
+	stats.m_totalStepTime += stats.m_stepTime;
+	stats.m_waitTime = stats.m_stepTime;
+	stats.m_latency = stats.m_stepTime;
+	stats.m_totalWaitTime += stats.m_waitTime;
+	stats.m_totalLatency += stats.m_latency;
+}
+
+void Model::EndPhysicsAnimation(const float elapsed) {
+	auto& stats = m_physicsStats;
+	const PhysicsFrame* frame = m_physicsPipeline ? m_physicsPipeline->Wait() : nullptr;
+	if (frame) {
+		stats.m_stepTime = frame->m_stepTime;
+		stats.m_totalStepTime += stats.m_stepTime;
+		stats.m_waitTime = m_physicsPipeline->m_waitTime;
+		stats.m_latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - frame->m_submitTime).count();
+		stats.m_totalWaitTime += stats.m_waitTime;
+		stats.m_totalLatency += stats.m_latency;
+	}
+	const auto start = std::chrono::steady_clock::now();
+	stats.m_activeBodyCount = 0;
+	stats.m_sleepingBodyCount = 0;
+	if (IsBakedPhysics()) {
+		m_physicsTrack->Sample(m_animFrame / 30.0f, *this);
+		for (const uint32_t index : m_physicsTrack->m_nodeIndices)
+			m_skeleton.MarkDirty(&m_nodes[index]);
+		m_skeleton.UpdateGlobalTransform();
+	} else if (m_physicsLod != PhysicsLod::Off) {
+		const bool interpolate = m_physicsLod == PhysicsLod::Full && m_physics->m_fixedTimeStep;
+		const float alpha = interpolate ? m_physics->m_alpha : 1.0f;
+		for (size_t i = 0; i < m_rigidBodies.size(); i++) {
+			const auto& rb = m_rigidBodies[i];
+			if (!frame)
+				rb->ReflectGlobalTransform(alpha, m_skeleton);
+			else if (const auto* motionState = rb->m_dynamicMotionState) {
+				m_skeleton.SetPhysicsGlobal(motionState->m_node, frame->m_globals[i],
+					motionState->m_boneMerge ? PhysicsWrite::Rotate : PhysicsWrite::Transform);
+			}
+			if (rb->m_rigidBody->isKinematicObject())
+				continue;
+			if (rb->m_rigidBody->isActive())
+				stats.m_activeBodyCount++;
+			else
+				stats.m_sleepingBodyCount++;
+		}
+		m_skeleton.ApplyPhysicsTransform();
+		if (!m_springBones.Empty()) {
+			m_springBones.Update(frame ? frame->m_elapsed : elapsed);
+			for (const auto& chain : m_springBones.m_chains)
+				m_skeleton.MarkDirty(m_springBones.m_nodes[chain.m_begin]);
+			m_skeleton.UpdateGlobalTransform();
+		}
 	}
+	stats.m_writeBackTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	stats.m_totalWriteBackTime += stats.m_writeBackTime;
+	stats.m_frameCount++;
+}
+
+void Model::UpdatePhysicsAnimation(const float elapsed) {
+	BeginPhysicsAnimation();
+	StepPhysics(elapsed);
+	EndPhysicsAnimation(elapsed);
+}
+
+void Model::WaitPhysics() {
+	if (m_physicsPipeline)
+		m_physicsPipeline->Wait();
+}
+
+void Model::SavePhysicsSnapshot(PhysicsSnapshot& snapshot) const {
+	if (m_physicsPipeline)
+		m_physicsPipeline->Wait();
+	snapshot.m_rigidBodies.clear();
+	snapshot.m_rigidBodies.reserve(m_rigidBodies.size());
+	for (const auto& rb : m_rigidBodies)
+		snapshot.m_rigidBodies.push_back(rb->GetState());
+	m_springBones.GetState(snapshot.m_springPositions, snapshot.m_springPrevPositions);
+}
+
+bool Model::RestorePhysicsSnapshot(const PhysicsSnapshot& snapshot) {
+	if (snapshot.m_rigidBodies.size() != m_rigidBodies.size())
+		return false;
+	if (!m_springBones.SetState(snapshot.m_springPositions, snapshot.m_springPrevPositions))
+		return false;
+	BeginPhysicsAnimation();
+	for (size_t i = 0; i < m_rigidBodies.size(); i++)
+		m_rigidBodies[i]->SetState(snapshot.m_rigidBodies[i], m_physics.get());
+	m_physics->ResetTimeStep();
+	EndPhysicsAnimation(0.0f);
+	return true;
+}
+
+void Model::SaveDrawState() {
+	UpdateDrawState();
+	m_drawMorphPositions = m_morphPositions;
+	m_drawMorphUVs = m_morphUVs;
+	m_drawStateSaved = true;
 }
 
 void Model::Update() {
-	for (size_t i = 0; i < m_nodes.size(); i++)
-		m_transforms[i] = m_nodes[i]->m_global * m_nodes[i]->m_inverseInit;
+	const bool savedMorphs = std::exchange(m_drawStateSaved, false);
+	if (!savedMorphs)
+		UpdateDrawState();
 	if (m_parallelUpdateCount != m_updateRanges.size())
 		SetupParallelUpdate();
-	const size_t futureCount = m_parallelUpdateFutures.size();
-	for (size_t i = 0; i < futureCount; i++) {
-		if (m_updateRanges[i + 1].m_vertexCount != 0) {
-			m_parallelUpdateFutures[i] = std::async(std::launch::async,
-			[this, range = m_updateRanges[i + 1]] { this->Update(range); }
-			);
+	JobPool::Get().ParallelFor(m_updateRanges.size(), 1, [this, savedMorphs](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			if (m_updateRanges[i].m_vertexCount != 0)
+				Update(m_updateRanges[i], savedMorphs);
 		}
-	}
-	Update(m_updateRanges[0]);
-	for (size_t i = 0; i < futureCount; i++) {
-		if (m_updateRanges[i + 1].m_vertexCount != 0)
-			m_parallelUpdateFutures[i].wait();
-	}
+	});
 }
 
-void Model::UpdateAllAnimation(const Animation* anim, const float frame, const float physicsElapsed) {
+void Model::BeginAllAnimation(const Animation* anim, const float frame) {
+	m_animFrame = frame;
 	if (anim)
 		anim->Evaluate(frame);
 	UpdateMorphAnimation();
 	UpdateNodeAnimation(false);
-	UpdatePhysicsAnimation(physicsElapsed);
+	BeginPhysicsAnimation();
+}
+
+void Model::EndAllAnimation(const float physicsElapsed) {
+	EndPhysicsAnimation(physicsElapsed);
 	UpdateNodeAnimation(true);
+	if (m_logIkStats)
+		LogIkSolverStats();
+}
+
+void Model::UpdateAllAnimation(const Animation* anim, const float frame, const float physicsElapsed) {
+	BeginAllAnimation(anim, frame);
+	StepPhysics(physicsElapsed);
+	EndAllAnimation(physicsElapsed);
+}
+
+const IkSolverStats* Model::GetIkSolverStats(const std::string& name) const {
+	const auto it = std::ranges::find(m_ikSolvers, name,
+		[](const std::unique_ptr<IkSolver>& ikSolver) { return ikSolver->m_ikNode->m_name; });
+	return it != m_ikSolvers.end() ? &(*it)->m_stats : nullptr;
+}
+
+double Model::GetIkSolverTime() const {
+	double time = 0;
+	for (const auto& ikSolver : m_ikSolvers)
+		time += ikSolver->m_enable ? ikSolver->m_stats.m_time : 0;
+	return time;
+}
+
+void Model::ResetIkSolverStats() {
+	for (const auto& ikSolver : m_ikSolvers)
+		ikSolver->m_stats.Reset();
+}
+
+void Model::LogIkSolverStats() const {
+	std::cout << m_modelName << " IK " << GetIkSolverTime() * 1000.0 << " ms\n";
+	for (const auto& ikSolver : m_ikSolvers) {
+		if (!ikSolver->m_enable)
+			continue;
+		const auto& stats = ikSolver->m_stats;
+		std::cout << "  " << ikSolver->m_ikNode->m_name
+			<< " iter " << stats.m_iterations << "/" << stats.m_iterateCount
+			<< " err " << stats.m_error
+			<< " rollback " << stats.m_rollback
+			<< " plane " << stats.m_planeCount
+			<< " time " << stats.m_time * 1000.0 << " ms"
+			<< " total solves " << stats.m_solveCount
+			<< " iter " << stats.m_totalIterations
+			<< " rollback " << stats.m_rollbackCount
+			<< " plane " << stats.m_totalPlaneCount << "\n";
+	}
+}
+
+void Model::LogPhysicsStats() const {
+	const auto& stats = m_physicsStats;
+	if (stats.m_frameCount == 0)
+		return;
+	const auto frameCount = static_cast<double>(stats.m_frameCount);
+	std::cout << m_modelName << " physics"
+		<< (m_physicsPipeline ? " pipelined" : " serial")
+		<< " step " << stats.m_totalStepTime * 1000.0 / frameCount << " ms"
+		<< " wait " << stats.m_totalWaitTime * 1000.0 / frameCount << " ms"
+		<< " latency " << stats.m_totalLatency * 1000.0 / frameCount << " ms"
+		<< " write back " << stats.m_totalWriteBackTime * 1000.0 / frameCount << " ms\n";
 }
 
 bool Model::Load(const std::filesystem::path& filepath, const std::filesystem::path& dataDir) {
@@ -315,28 +570,30 @@ bool Model::Load(const std::filesystem::path& filepath, const std::filesystem::p
 		beginIndex += mat.m_numFaceVertices;
 	}
 	m_initMaterials = m_materials;
+	m_drawMaterials = m_materials;
 	m_mulMaterialFactors.resize(m_materials.size());
 	m_addMaterialFactors.resize(m_materials.size());
-	m_nodes.reserve(pmx.m_bones.size());
-	for (const auto& bone : pmx.m_bones) {
-		auto node = std::make_unique<Node>();
-		node->m_index = static_cast<uint32_t>(m_nodes.size());
-		node->m_name = bone.m_name;
-		m_nodes.emplace_back(std::move(node));
+	m_nodes.resize(pmx.m_bones.size());
+	m_skeleton.m_pose.Resize(pmx.m_bones.size());
+	for (size_t i = 0; i < pmx.m_bones.size(); i++) {
+		auto& node = m_nodes[i];
+		node.m_index = static_cast<uint32_t>(i);
+		node.m_pose = &m_skeleton.m_pose;
+		node.m_name = pmx.m_bones[i].m_name;
 	}
 	for (size_t i = 0; i < pmx.m_bones.size(); i++) {
 		const auto& bone = pmx.m_bones[i];
-		auto* node = m_nodes[i].get();
+		auto* node = &m_nodes[i];
 		glm::vec3 localPos = bone.m_position;
 		if (bone.m_parentBoneIndex != -1) {
-			auto* parent = m_nodes[bone.m_parentBoneIndex].get();
+			auto* parent = &m_nodes[bone.m_parentBoneIndex];
 			parent->AddChild(node);
 			localPos -= pmx.m_bones[bone.m_parentBoneIndex].m_position;
 		}
 		localPos.z *= -1;
 		node->m_translate = localPos;
-		node->m_global = glm::translate(glm::mat4(1), bone.m_position * invZ);
-		node->m_inverseInit = glm::inverse(node->m_global);
+		node->GetGlobal() = glm::translate(glm::mat4(1), bone.m_position * invZ);
+		m_skeleton.m_pose.m_inverseInits[i] = glm::inverse(node->GetGlobal());
 		node->m_deformDepth = bone.m_deformDepth;
 		bool deformAfterPhysics = (static_cast<uint16_t>(bone.m_boneFlag) & static_cast<uint16_t>(BoneFlags::DeformAfterPhysics)) != 0;
 		node->m_isDeformAfterPhysics = deformAfterPhysics;
@@ -346,7 +603,7 @@ bool Model::Load(const std::filesystem::path& filepath, const std::filesystem::p
 		node->m_isAppendTranslate = appendTranslate;
 		if ((appendRotate || appendTranslate) && bone.m_appendBoneIndex != -1) {
 			bool appendLocal = (static_cast<uint16_t>(bone.m_boneFlag) & static_cast<uint16_t>(BoneFlags::AppendLocal)) != 0;
-			auto* appendNode = m_nodes[bone.m_appendBoneIndex].get();
+			auto* appendNode = &m_nodes[bone.m_appendBoneIndex];
 			float appendWeight = bone.m_appendWeight;
 			node->m_isAppendLocal = appendLocal;
 			node->m_appendNode = appendNode;
@@ -357,10 +614,11 @@ bool Model::Load(const std::filesystem::path& filepath, const std::filesystem::p
 		node->m_initScale = node->m_scale;
 	}
 	m_transforms.resize(m_nodes.size());
+	m_skeleton.Create(m_nodes);
 	m_sortedNodes.clear();
 	m_sortedNodes.reserve(m_nodes.size());
 	for (auto& node : m_nodes)
-		m_sortedNodes.push_back(node.get());
+		m_sortedNodes.push_back(&node);
 	std::ranges::stable_sort(m_sortedNodes,
 		[](const Node* x, const Node* y) { return x->m_deformDepth < y->m_deformDepth; }
 	);
@@ -368,11 +626,12 @@ bool Model::Load(const std::filesystem::path& filepath, const std::filesystem::p
 		const auto& bone = pmx.m_bones[i];
 		if (static_cast<uint16_t>(bone.m_boneFlag) & static_cast<uint16_t>(BoneFlags::IK)) {
 			auto solver = std::make_unique<IkSolver>();
-			solver->m_ikNode = m_nodes[i].get();
-			m_nodes[i]->m_ikSolver = solver.get();
-			solver->m_ikTarget = m_nodes[bone.m_ikTargetBoneIndex].get();
+			solver->m_ikNode = &m_nodes[i];
+			solver->m_skeleton = &m_skeleton;
+			m_nodes[i].m_ikSolver = solver.get();
+			solver->m_ikTarget = &m_nodes[bone.m_ikTargetBoneIndex];
 			for (const auto& [m_ikBoneIndex, m_enableLimit, m_limitMin, m_limitMax] : bone.m_ikLinks) {
-				auto* linkNode = m_nodes[m_ikBoneIndex].get();
+				auto* linkNode = &m_nodes[m_ikBoneIndex];
 				IKChain chain{};
 				chain.m_node = linkNode;
 				chain.m_enableAxisLimit = m_enableLimit;
@@ -384,9 +643,15 @@ bool Model::Load(const std::filesystem::path& filepath, const std::filesystem::p
 			}
 			solver->m_iterateCount = bone.m_ikIterationCount;
 			solver->m_limitAngle = bone.m_ikLimit;
+			solver->m_warmStart = m_ikWarmStart;
+			solver->SetupChainPath();
+			if (m_useAnalyticIk)
+				solver->SetupSolverType();
 			m_ikSolvers.emplace_back(std::move(solver));
 		}
 	}
+	m_nodeSchedules[0].Create(m_sortedNodes, false);
+	m_nodeSchedules[1].Create(m_sortedNodes, true);
 	for (const auto& morph : pmx.m_morphs) {
 		auto m = std::make_unique<Morph>();
 		m->m_name = morph.m_name;
@@ -456,44 +721,82 @@ bool Model::Load(const std::filesystem::path& filepath, const std::filesystem::p
 		groupMorphStack.clear();
 		fixInfiniteGroupMorph(i);
 	}
-	m_physics = std::make_unique<Physics>();
-	m_physics->Create();
+	if (m_scenePhysics)
+		m_physics = m_scenePhysics;
+	else {
+		m_physics = std::make_shared<Physics>();
+		m_physics->m_multiThreaded = m_multiThreadedPhysics;
+		m_physics->m_fixedTimeStep = m_fixedTimeStepPhysics;
+		m_physics->m_maxStepCount = m_maxPhysicsStepCount;
+		m_physics->Create();
+	}
+	m_physicsSlot = m_physics->AddModel();
 	for (const auto& rigidBody : pmx.m_rigidBodies) {
 		auto rb = std::make_unique<RigidBody>();
 		Node* node = nullptr;
 		if (rigidBody.m_boneIndex != -1)
-			node = m_nodes[rigidBody.m_boneIndex].get();
+			node = &m_nodes[rigidBody.m_boneIndex];
 		rb->Create(rigidBody, this, node);
-		m_physics->m_world->addRigidBody(rb->m_rigidBody.get(), 1 << rb->m_group, rb->m_groupMask);
+		rb->SetSleeping(m_physicsSleeping);
 		m_rigidBodies.emplace_back(std::move(rb));
 	}
+	std::vector<bool> springMapped(m_rigidBodies.size(), false);
+	if (m_useSpringBones)
+		m_springBones.Create(pmx.m_rigidBodies, pmx.m_joints, m_rigidBodies, springMapped);
+	for (size_t i = 0; i < m_rigidBodies.size(); i++) {
+		if (springMapped[i])
+			continue;
+		const auto& rb = m_rigidBodies[i];
+		m_physics->m_world->addRigidBody(rb->m_rigidBody.get(),
+			Physics::MakeFilterGroup(1 << rb->m_group, m_physicsSlot), rb->m_groupMask);
+	}
 	for (const auto& joint : pmx.m_joints) {
 		if (joint.m_rigidbodyAIndex != -1 &&
 		    joint.m_rigidbodyBIndex != -1 &&
-		    joint.m_rigidbodyAIndex != joint.m_rigidbodyBIndex) {
+		    joint.m_rigidbodyAIndex != joint.m_rigidbodyBIndex &&
+		    !springMapped[joint.m_rigidbodyAIndex] &&
+		    !springMapped[joint.m_rigidbodyBIndex]) {
 			auto j = std::make_unique<Joint>();
 			j->Create(joint,
 				m_rigidBodies[joint.m_rigidbodyAIndex].get(),
-				m_rigidBodies[joint.m_rigidbodyBIndex].get()
+				m_rigidBodies[joint.m_rigidbodyBIndex].get(),
+				m_jointMode
 			);
 			m_physics->m_world->addConstraint(j->m_constraint.get());
 			m_joints.emplace_back(std::move(j));
 		}
 	}
+	size_t rigidBodyCount = 0;
+	for (size_t i = 0; i < m_rigidBodies.size(); i++) {
+		if (!springMapped[i])
+			m_rigidBodies[rigidBodyCount++] = std::move(m_rigidBodies[i]);
+	}
+	m_rigidBodies.resize(rigidBodyCount);
+	if (m_pipelinedPhysics && !m_scenePhysics) {
+		m_physicsPipeline = std::make_unique<PhysicsPipeline>();
+		m_physicsPipeline->Start([this](PhysicsFrame& frame) { SimulatePhysics(frame); });
+	}
 	ResetPhysics();
 	SetupParallelUpdate();
 	return true;
 }
 
 void Model::Destroy() {
+	m_physicsPipeline.reset();
 	m_materials.clear();
+	m_drawMaterials.clear();
+	m_drawMorphPositions.clear();
+	m_drawMorphUVs.clear();
+	m_drawStateSaved = false;
 	m_subMeshes.clear();
 	m_positions.clear();
 	m_normals.clear();
 	m_uvs.clear();
 	m_vertexBoneInfos.clear();
 	m_indices.clear();
+	m_springBones.Clear();
 	m_nodes.clear();
+	m_skeleton.Clear();
 	m_updateRanges.clear();
 	for (const auto& joint : m_joints)
 		m_physics->m_world->removeConstraint(joint->m_constraint.get());
@@ -501,15 +804,63 @@ void Model::Destroy() {
 	for (const auto& rb : m_rigidBodies)
 		m_physics->m_world->removeRigidBody(rb->m_rigidBody.get());
 	m_rigidBodies.clear();
+	CollisionShapeCache::Get().Prune();
+	if (m_physics)
+		m_physics->RemoveModel(m_physicsSlot);
 	m_physics.reset();
 }
 
+void Model::UpdateKinematicTransforms(const bool activation) {
+	constexpr size_t LowerRigidBodyCount = 256;
+	const auto update = [this, activation](const size_t begin, const size_t end) {
+		for (size_t i = begin; i < end; i++) {
+			if (m_rigidBodies[i]->IsKinematic(activation))
+				m_rigidBodies[i]->UpdateKinematicTransform();
+		}
+	};
+	if (m_rigidBodies.size() >= LowerRigidBodyCount)
+		JobPool::Get().ParallelFor(m_rigidBodies.size(), LowerRigidBodyCount / 2, update);
+	else
+		update(0, m_rigidBodies.size());
+}
+
+double Model::SimulatePhysics(const float elapsed) {
+	const auto start = std::chrono::steady_clock::now();
+	switch (m_physicsLod) {
+		case PhysicsLod::Full:
+			m_physics->Step(elapsed);
+			break;
+		case PhysicsLod::Reduced:
+			m_reducedPhysicsElapsed += elapsed;
+			if (++m_physicsFrame % 2 == 0) {
+				m_physics->StepReduced(m_reducedPhysicsElapsed);
+				m_reducedPhysicsElapsed = 0;
+			}
+			break;
+		case PhysicsLod::Off:
+			break;
+	}
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Model::SimulatePhysics(PhysicsFrame& frame) {
+	frame.m_stepTime = SimulatePhysics(frame.m_elapsed);
+	if (m_physicsLod == PhysicsLod::Off)
+		return;
+	const bool interpolate = m_physicsLod == PhysicsLod::Full && m_physics->m_fixedTimeStep;
+	const float alpha = interpolate ? m_physics->m_alpha : 1.0f;
+	frame.m_globals.resize(m_rigidBodies.size());
+	for (size_t i = 0; i < m_rigidBodies.size(); i++) {
+		if (m_rigidBodies[i]->m_dynamicMotionState)
+			frame.m_globals[i] = m_rigidBodies[i]->GetGlobalTransform(alpha);
+	}
+}
+
 void Model::SetupParallelUpdate() {
 	if (!m_parallelUpdateCount)
-		m_parallelUpdateCount = std::max(1u, std::thread::hardware_concurrency());
+		m_parallelUpdateCount = static_cast<uint32_t>(JobPool::Get().GetThreadCount());
 	m_parallelUpdateCount = std::min<size_t>(m_parallelUpdateCount, 16);
 	m_updateRanges.resize(m_parallelUpdateCount);
-	m_parallelUpdateFutures.resize(m_parallelUpdateCount - 1);
 	const size_t vertexCount = m_positions.size();
 	constexpr size_t LowerVertexCount = 1000;
 	if (vertexCount < m_updateRanges.size() * LowerVertexCount) {
@@ -536,12 +887,20 @@ void Model::SetupParallelUpdate() {
 	}
 }
 
-void Model::Update(const UpdateRange& range) {
+void Model::UpdateDrawState() {
+	const auto& globals = m_skeleton.m_pose.m_globals;
+	const auto& inverseInits = m_skeleton.m_pose.m_inverseInits;
+	for (size_t i = 0; i < globals.size(); i++)
+		m_transforms[i] = globals[i] * inverseInits[i];
+	std::ranges::copy(m_materials, m_drawMaterials.begin());
+}
+
+void Model::Update(const UpdateRange& range, const bool savedMorphs) {
 	const auto* position = m_positions.data() + range.m_vertexOffset;
 	const auto* normal = m_normals.data() + range.m_vertexOffset;
 	const auto* uv = m_uvs.data() + range.m_vertexOffset;
-	const auto* morphPos = m_morphPositions.data() + range.m_vertexOffset;
-	const auto* morphUV = m_morphUVs.data() + range.m_vertexOffset;
+	const auto* morphPos = (savedMorphs ? m_drawMorphPositions : m_morphPositions).data() + range.m_vertexOffset;
+	const auto* morphUV = (savedMorphs ? m_drawMorphUVs : m_morphUVs).data() + range.m_vertexOffset;
 	const auto* vtxInfo = m_vertexBoneInfos.data() + range.m_vertexOffset;
 	const auto* transforms = m_transforms.data();
 	auto* updatePos = m_updatePositions.data() + range.m_vertexOffset;
@@ -573,8 +932,8 @@ void Model::Update(const UpdateRange& range) {
 				const auto i0 = vtxInfo->m_boneIndices[0], i1 = vtxInfo->m_boneIndices[1];
 				const auto w0 = vtxInfo->m_boneWeights[0], w1 = 1.0f - w0;
 				const auto center = vtxInfo->m_sdefC, cr0 = vtxInfo->m_sdefR0, cr1 = vtxInfo->m_sdefR1;
-				const auto q0 = glm::quat_cast(m_nodes[i0]->m_global);
-				const auto q1 = glm::quat_cast(m_nodes[i1]->m_global);
+				const auto q0 = glm::quat_cast(transforms[i0]);
+				const auto q1 = glm::quat_cast(transforms[i1]);
 				const auto rot_mat = glm::mat3_cast(glm::slerp(q0, q1, w1));
 				const auto m0 = transforms[i0], m1 = transforms[i1];
 				const auto pos = *position + *morphPos;
@@ -712,9 +1071,9 @@ void Model::MorphMaterial(const std::vector<MaterialMorph>& morphData, const flo
 	}
 }
 
-void Model::MorphBone(const std::vector<BoneMorph>& morphData, const float weight) const {
+void Model::MorphBone(const std::vector<BoneMorph>& morphData, const float weight) {
 	for (const auto& [m_boneIndex, m_position, m_quaternion] : morphData) {
-		auto* node = m_nodes[m_boneIndex].get();
+		auto* node = &m_nodes[m_boneIndex];
 		node->m_translate += m_position * weight;
 		const glm::quat q = glm::slerp(glm::quat(1,0,0,0), m_quaternion, weight);
 		node->m_rotate = glm::normalize(q * node->m_rotate);
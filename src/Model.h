@@ -1,10 +1,10 @@
 ﻿#pragma once
 
-#include <future>
-
 #include "Node.h"
 #include "IkSolver.h"
 #include "Physics.h"
+#include "Skeleton.h"
+#include "SpringBone.h"
 
 struct GroupMorph;
 struct BoneMorph;
@@ -14,6 +14,10 @@ struct MaterialMorph;
 struct RigidBody;
 struct Joint;
 struct Animation;
+struct PhysicsSnapshot;
+struct PhysicsTrack;
+struct PhysicsPipeline;
+struct PhysicsFrame;
 
 enum class SphereMode : uint8_t;
 enum class MorphType : uint8_t;
@@ -66,6 +70,26 @@ struct Material {
 	bool					m_shadowReceiver = true;
 };
 
+enum class PhysicsLod : uint8_t {
+	Full,
+	Reduced,
+	Off
+};
+
+struct PhysicsStats {
+	double		m_stepTime = 0;
+	double		m_writeBackTime = 0;
+	double		m_waitTime = 0;
+	double		m_latency = 0;
+	uint32_t	m_activeBodyCount = 0;
+	uint32_t	m_sleepingBodyCount = 0;
+	uint64_t	m_frameCount = 0;
+	double		m_totalStepTime = 0;
+	double		m_totalWriteBackTime = 0;
+	double		m_totalWaitTime = 0;
+	double		m_totalLatency = 0;
+};
+
 struct UpdateRange {
 	size_t m_vertexOffset;
 	size_t m_vertexCount;
@@ -97,45 +121,101 @@ public:
 	std::vector<std::vector<GroupMorph>>	m_groupMorphDatas;
 	std::vector<glm::vec3>					m_morphPositions;
 	std::vector<glm::vec4>					m_morphUVs;
+	std::vector<glm::vec3>					m_drawMorphPositions;
+	std::vector<glm::vec4>					m_drawMorphUVs;
+	bool									m_drawStateSaved = false;
 	std::vector<Material>					m_initMaterials;
 	std::vector<MaterialMorph>				m_mulMaterialFactors;
 	std::vector<MaterialMorph>				m_addMaterialFactors;
 	glm::vec3								m_bboxMin;
 	glm::vec3								m_bboxMax;
 	std::vector<Material>					m_materials;
+	std::vector<Material>					m_drawMaterials;
 	std::vector<SubMesh>					m_subMeshes;
 	std::vector<Node*>						m_sortedNodes;
-	std::vector<std::unique_ptr<Node>>		m_nodes;
+	NodeSchedule							m_nodeSchedules[2];
+	std::vector<Node>						m_nodes;
+	Skeleton								m_skeleton;
 	std::vector<std::unique_ptr<IkSolver>>	m_ikSolvers;
 	std::vector<std::unique_ptr<Morph>>		m_morphs;
-	std::unique_ptr<Physics>				m_physics;
+	std::shared_ptr<Physics>				m_physics;
+	std::shared_ptr<Physics>				m_scenePhysics;
+	uint16_t								m_physicsSlot = 0;
 	std::vector<std::unique_ptr<RigidBody>>	m_rigidBodies;
 	std::vector<std::unique_ptr<Joint>>		m_joints;
+	SpringBoneSolver						m_springBones;
+	bool									m_useSpringBones = false;
+	JointMode								m_jointMode = JointMode::Typed;
+	std::shared_ptr<PhysicsTrack>			m_physicsTrack;
+	bool									m_useBakedPhysics = false;
+	float									m_animFrame = 0;
 	uint32_t								m_parallelUpdateCount = 0;
+	bool									m_useAnalyticIk = false;
+	bool									m_ikWarmStart = false;
+	bool									m_logIkStats = false;
+	bool									m_multiThreadedPhysics = false;
+	bool									m_fixedTimeStepPhysics = false;
+	int										m_maxPhysicsStepCount = 4;
+	PhysicsLod								m_physicsLod = PhysicsLod::Full;
+	bool									m_autoPhysicsLod = false;
+	float									m_physicsReducedScreenSize = 0.25f;
+	float									m_physicsOffScreenSize = 0.0f;
+	bool									m_physicsSleeping = false;
+	float									m_physicsWakeDistance = 0.01f;
+	bool									m_fastPhysicsWarmUp = false;
+	uint32_t								m_physicsFrame = 0;
+	float									m_reducedPhysicsElapsed = 0;
+	bool									m_pipelinedPhysics = false;
+	std::unique_ptr<PhysicsPipeline>		m_physicsPipeline;
+	PhysicsStats							m_physicsStats;
 	std::vector<UpdateRange>				m_updateRanges;
-	std::vector<std::future<void>>			m_parallelUpdateFutures;
 
 	void InitializeAnimation();
-	void SaveBaseAnimation() const;
-	void ClearBaseAnimation() const;
+	void SaveBaseAnimation();
+	void ClearBaseAnimation();
 	void BeginAnimation();
 	void UpdateMorphAnimation();
-	void UpdateNodeAnimation(bool afterPhysicsAnim) const;
-	void ResetPhysics() const;
-	void UpdatePhysicsAnimation(float elapsed) const;
+	void UpdateNodeAnimation(bool afterPhysicsAnim);
+	void ResetPhysics();
+	void BeginResetPhysics();
+	void EndResetPhysics();
+	void SetPhysicsLod(PhysicsLod lod);
+	void SetBakedPhysics(bool useBakedPhysics);
+	bool IsBakedPhysics() const;
+	void GetPhysicsNodes(std::vector<uint32_t>& nodeIndices) const;
+	void SelectPhysicsLod(const glm::mat4& view, const glm::mat4& proj);
+	void BeginPhysicsAnimation();
+	void StepPhysics(float elapsed);
+	void EndPhysicsAnimation(float elapsed);
+	void UpdatePhysicsAnimation(float elapsed);
+	void WaitPhysics();
+	void SavePhysicsSnapshot(PhysicsSnapshot& snapshot) const;
+	bool RestorePhysicsSnapshot(const PhysicsSnapshot& snapshot);
+	void SaveDrawState();
 	void Update();
+	void BeginAllAnimation(const Animation* anim, float frame);
+	void EndAllAnimation(float physicsElapsed);
 	void UpdateAllAnimation(const Animation* anim, float frame, float physicsElapsed);
 	bool Load(const std::filesystem::path& filepath, const std::filesystem::path& dataDir);
 	void Destroy();
+	const IkSolverStats* GetIkSolverStats(const std::string& name) const;
+	double GetIkSolverTime() const;
+	void ResetIkSolverStats();
+	void LogIkSolverStats() const;
+	void LogPhysicsStats() const;
 
 private:
+	void UpdateKinematicTransforms(bool activation);
+	double SimulatePhysics(float elapsed);
+	void SimulatePhysics(PhysicsFrame& frame);
 	void SetupParallelUpdate();
-	void Update(const UpdateRange& range);
+	void UpdateDrawState();
+	void Update(const UpdateRange& range, bool savedMorphs);
 	void EvalMorph(const Morph* morph, float weight);
 	void MorphPosition(const std::vector<PositionMorph>& morphData, float weight);
 	void MorphUV(const std::vector<UVMorph>& morphData, float weight);
 	void BeginMorphMaterial();
 	void EndMorphMaterial();
 	void MorphMaterial(const std::vector<MaterialMorph>& morphData, float weight);
-	void MorphBone(const std::vector<BoneMorph>& morphData, float weight) const;
+	void MorphBone(const std::vector<BoneMorph>& morphData, float weight);
 };
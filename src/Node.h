@@ -1,12 +1,25 @@
 ﻿#pragma once
 
 #include <string>
+#include <vector>
 #include <glm/gtc/quaternion.hpp>
 
 struct IkSolver;
 
+struct NodePose {
+	std::vector<glm::vec3>	m_animTranslates;
+	std::vector<glm::quat>	m_animRotates;
+	std::vector<glm::mat4>	m_locals;
+	std::vector<glm::mat4>	m_globals;
+	std::vector<glm::mat4>	m_inverseInits;
+
+	void Resize(size_t count);
+	void Clear();
+};
+
 struct Node {
 	uint32_t	m_index = 0;
+	NodePose*	m_pose = nullptr;
 	std::string	m_name;
 	bool		m_enableIK = false;
 	Node*		m_parent = nullptr;
@@ -16,14 +29,9 @@ struct Node {
 	glm::vec3	m_translate = glm::vec3(0);
 	glm::quat	m_rotate = glm::quat(1, 0, 0, 0);
 	glm::vec3	m_scale = glm::vec3(1);
-	glm::vec3	m_animTranslate = glm::vec3(0);
-	glm::quat	m_animRotate = glm::quat(1, 0, 0, 0);
 	glm::vec3	m_baseAnimTranslate = glm::vec3(0);
 	glm::quat	m_baseAnimRotate = glm::quat(1, 0, 0, 0);
 	glm::quat	m_ikRotate = glm::quat(1, 0, 0, 0);
-	glm::mat4	m_local = glm::mat4(1);
-	glm::mat4	m_global = glm::mat4(1);
-	glm::mat4	m_inverseInit = glm::mat4(1);
 	glm::vec3	m_initTranslate = glm::vec3(0);
 	glm::quat	m_initRotate = glm::quat(1, 0, 0, 0);
 	glm::vec3	m_initScale = glm::vec3(1);
@@ -38,10 +46,12 @@ struct Node {
 	glm::quat	m_appendRotate = glm::quat(1, 0, 0, 0);
 	IkSolver*	m_ikSolver = nullptr;
 
+	glm::vec3& GetAnimTranslate() const { return m_pose->m_animTranslates[m_index]; }
+	glm::quat& GetAnimRotate() const { return m_pose->m_animRotates[m_index]; }
+	glm::mat4& GetLocal() const { return m_pose->m_locals[m_index]; }
+	glm::mat4& GetGlobal() const { return m_pose->m_globals[m_index]; }
 	void AddChild(Node* child);
 	void BeginUpdateTransform();
 	void UpdateLocalTransform();
-	void UpdateGlobalTransform();
-	void UpdateChildTransform() const;
 	void UpdateAppendTransform();
 };
@@ -1,14 +1,54 @@
 ﻿#include "Physics.h"
 
+#include "JobPool.h"
 #include "Model.h"
 #include "Util.h"
 
+#include <mutex>
+
+JobPoolTaskScheduler::JobPoolTaskScheduler()
+	: btITaskScheduler("JobPool")
+	, m_numThreads(static_cast<int>(JobPool::Get().GetThreadCount())) {
+}
+
+int JobPoolTaskScheduler::getMaxNumThreads() const {
+	return static_cast<int>(JobPool::Get().GetThreadCount());
+}
+
+void JobPoolTaskScheduler::setNumThreads(const int numThreads) {
+	m_numThreads = glm::clamp(numThreads, 1, getMaxNumThreads());
+}
+
+void JobPoolTaskScheduler::parallelFor(const int iBegin, const int iEnd, const int grainSize, const btIParallelForBody& body) {
+	btPushThreadsAreRunning();
+	JobPool::Get().ParallelFor(iEnd - iBegin, grainSize, [iBegin, &body](const size_t begin, const size_t end) {
+		body.forLoop(iBegin + static_cast<int>(begin), iBegin + static_cast<int>(end));
+	});
+	btPopThreadsAreRunning();
+}
+
+btScalar JobPoolTaskScheduler::parallelSum(const int iBegin, const int iEnd, const int grainSize, const btIParallelSumBody& body) {
+	btScalar sum = 0;
+	std::mutex sumMutex;
+	btPushThreadsAreRunning();
+	JobPool::Get().ParallelFor(iEnd - iBegin, grainSize, [iBegin, &body, &sum, &sumMutex](const size_t begin, const size_t end) {
+		const btScalar partial = body.sumLoop(iBegin + static_cast<int>(begin), iBegin + static_cast<int>(end));
+		std::lock_guard lock(sumMutex);
+		sum += partial;
+	});
+	btPopThreadsAreRunning();
+	return sum;
+}
+
 bool OverlapFilterCallback::needBroadphaseCollision(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1) const {
-	const auto endIt = m_nonFilterProxy.end();
-	if (std::ranges::find(m_nonFilterProxy, proxy0) != endIt || std::ranges::find(m_nonFilterProxy, proxy1) != endIt)
+	if ((proxy0->m_collisionFilterGroup | proxy1->m_collisionFilterGroup) & Physics::NonFilterGroup)
 		return true;
-	bool collides = (proxy0->m_collisionFilterGroup & proxy1->m_collisionFilterMask) != 0;
-	collides = collides && (proxy1->m_collisionFilterGroup & proxy0->m_collisionFilterMask) != 0;
+	const int slot0 = proxy0->m_collisionFilterGroup >> Physics::ModelSlotShift & Physics::ModelSlotMask;
+	const int slot1 = proxy1->m_collisionFilterGroup >> Physics::ModelSlotShift & Physics::ModelSlotMask;
+	if (slot0 != slot1)
+		return m_interModelCollision;
+	bool collides = (proxy0->m_collisionFilterGroup & proxy1->m_collisionFilterMask & Physics::GroupMask) != 0;
+	collides = collides && (proxy1->m_collisionFilterGroup & proxy0->m_collisionFilterMask & Physics::GroupMask) != 0;
 	return collides;
 }
 
@@ -18,60 +58,97 @@ DefaultMotionState::DefaultMotionState(const glm::mat4& transform) {
 	m_initialTransform = m_transform;
 }
 
-DynamicMotionState::DynamicMotionState(Node* node, const glm::mat4& offset)
+DynamicMotionState::DynamicMotionState(Node* node, const glm::mat4& offset, const bool boneMerge)
 	: m_node(node)
-	, m_offset(offset) {
+	, m_offset(offset)
+	, m_btOffset(Util::InvZ(offset))
+	, m_boneMerge(boneMerge) {
 	m_invOffset = glm::inverse(offset);
 	DynamicMotionState::Reset();
 }
 
+void DynamicMotionState::setWorldTransform(const btTransform& worldTransform) {
+	m_prevTransform = m_transform;
+	m_transform = worldTransform;
+}
+
 void DynamicMotionState::Reset() {
-	glm::mat4 global = Util::InvZ(m_node->m_global * m_offset);
+	const glm::mat4 global = Util::InvZ(m_node->GetGlobal()) * m_btOffset;
 	m_transform.setFromOpenGLMatrix(&global[0][0]);
+	m_prevTransform = m_transform;
 }
 
-void DynamicMotionState::ReflectGlobalTransform() {
-	glm::mat4 world;
-	m_transform.getOpenGLMatrix(&world[0][0]);
-	glm::mat4 btGlobal = Util::InvZ(world) * m_invOffset;
-	PostProcessBtGlobal(btGlobal);
-	m_node->m_global = btGlobal;
-	m_node->UpdateChildTransform();
+void DynamicMotionState::SetTransform(const btTransform& transform) {
+	m_transform = transform;
+	m_prevTransform = transform;
 }
 
-void DynamicAndBoneMergeMotionState::PostProcessBtGlobal(glm::mat4& btGlobal) const {
-	btGlobal[3] = m_node->m_global[3];
+glm::mat4 DynamicMotionState::GetGlobalTransform(const float alpha) const {
+	btTransform transform = m_transform;
+	if (alpha < 1.0f) {
+		transform.setOrigin(m_prevTransform.getOrigin().lerp(m_transform.getOrigin(), alpha));
+		transform.setRotation(m_prevTransform.getRotation().slerp(m_transform.getRotation(), alpha));
+	}
+	glm::mat4 world;
+	transform.getOpenGLMatrix(&world[0][0]);
+	return Util::InvZ(world) * m_invOffset;
 }
 
 KinematicMotionState::KinematicMotionState(Node* node, const glm::mat4& offset)
 	: m_node(node)
-	, m_offset(offset) {
+	, m_offset(offset)
+	, m_btOffset(Util::InvZ(offset)) {
+	UpdateTransform();
 }
 
-void KinematicMotionState::getWorldTransform(btTransform& worldTransform) const {
-	glm::mat4 global = Util::InvZ(m_node->m_global * m_offset);
-	worldTransform.setFromOpenGLMatrix(&global[0][0]);
+void KinematicMotionState::UpdateTransform() {
+	const glm::mat4 global = Util::InvZ(m_node->GetGlobal()) * m_btOffset;
+	m_transform.setFromOpenGLMatrix(&global[0][0]);
 }
 
-void RigidBody::Create(const PMXReader::PMXRigidbody& pmxRigidBody, const Model* model, Node * node) {
-	switch (pmxRigidBody.m_shape) {
+CollisionShapeCache& CollisionShapeCache::Get() {
+	static CollisionShapeCache cache;
+	return cache;
+}
+
+std::shared_ptr<btCollisionShape> CollisionShapeCache::GetShape(const Shape shape, const glm::vec3& size) {
+	glm::vec3 key = size;
+	if (shape == Shape::Sphere)
+		key.y = key.z = 0;
+	else if (shape == Shape::Capsule)
+		key.z = 0;
+	std::lock_guard lock(m_mutex);
+	auto& cached = m_shapes[{ shape, key.x, key.y, key.z }];
+	if (auto collisionShape = cached.lock())
+		return collisionShape;
+	std::shared_ptr<btCollisionShape> collisionShape;
+	switch (shape) {
 		case Shape::Sphere:
-			m_shape = std::make_unique<btSphereShape>(pmxRigidBody.m_shapeSize.x);
+			collisionShape = std::make_shared<btSphereShape>(key.x);
 			break;
 		case Shape::Box:
-			m_shape = std::make_unique<btBoxShape>(btVector3(
-				pmxRigidBody.m_shapeSize.x,
-				pmxRigidBody.m_shapeSize.y,
-				pmxRigidBody.m_shapeSize.z
-			));
+			collisionShape = std::make_shared<btBoxShape>(btVector3(key.x, key.y, key.z));
 			break;
 		case Shape::Capsule:
-			m_shape = std::make_unique<btCapsuleShape>(
-				pmxRigidBody.m_shapeSize.x,
-				pmxRigidBody.m_shapeSize.y
-			);
+			collisionShape = std::make_shared<btCapsuleShape>(key.x, key.y);
 			break;
 	}
+	cached = collisionShape;
+	return collisionShape;
+}
+
+void CollisionShapeCache::Prune() {
+	std::lock_guard lock(m_mutex);
+	std::erase_if(m_shapes, [](const auto& shape) { return shape.second.expired(); });
+}
+
+size_t CollisionShapeCache::GetShapeCount() {
+	std::lock_guard lock(m_mutex);
+	return m_shapes.size();
+}
+
+void RigidBody::Create(const PMXReader::PMXRigidbody& pmxRigidBody, Model* model, Node * node) {
+	m_shape = CollisionShapeCache::Get().GetShape(pmxRigidBody.m_shape, pmxRigidBody.m_shapeSize);
 	btScalar mass(0.0f);
 	btVector3 localInertia(0, 0, 0);
 	if (pmxRigidBody.m_op != Operation::Static)
@@ -84,15 +161,15 @@ void RigidBody::Create(const PMXReader::PMXRigidbody& pmxRigidBody, const Model*
 	const glm::mat4 rotMat = ry * rx * rz;
 	const glm::mat4 translateMat = glm::translate(glm::mat4(1), pmxRigidBody.m_translate);
 	const glm::mat4 rbMat = Util::InvZ(translateMat * rotMat);
-	auto* kinematicNode = node ? node : model->m_nodes[0].get();
-	m_offsetMat = glm::inverse(kinematicNode->m_global) * rbMat;
+	auto* kinematicNode = node ? node : &model->m_nodes[0];
+	m_offsetMat = glm::inverse(kinematicNode->GetGlobal()) * rbMat;
 	m_kinematicMotionState = std::make_unique<KinematicMotionState>(kinematicNode, m_offsetMat);
 	if (pmxRigidBody.m_op != Operation::Static) {
 		if (node) {
-			if (pmxRigidBody.m_op == Operation::Dynamic)
-				m_activeMotionState = std::make_unique<DynamicMotionState>(kinematicNode, m_offsetMat);
-			else
-				m_activeMotionState = std::make_unique<DynamicAndBoneMergeMotionState>(kinematicNode, m_offsetMat);
+			auto dynamicMotionState = std::make_unique<DynamicMotionState>(
+				kinematicNode, m_offsetMat, pmxRigidBody.m_op == Operation::DynamicAndBoneMerge);
+			m_dynamicMotionState = dynamicMotionState.get();
+			m_activeMotionState = std::move(dynamicMotionState);
 		} else
 			m_activeMotionState = std::make_unique<DefaultMotionState>(m_offsetMat);
 	}
@@ -119,10 +196,13 @@ void RigidBody::Create(const PMXReader::PMXRigidbody& pmxRigidBody, const Model*
 void RigidBody::SetActivation(const bool activation) const {
 	if (m_rigidBodyType != Operation::Static) {
 		if (activation) {
+			if (m_allowSleeping && m_rigidBody->isKinematicObject())
+				m_rigidBody->forceActivationState(ACTIVE_TAG);
 			m_rigidBody->setCollisionFlags(
 				m_rigidBody->getCollisionFlags() & ~btCollisionObject::CF_KINEMATIC_OBJECT);
 			m_rigidBody->setMotionState(m_activeMotionState.get());
 		} else {
+			m_rigidBody->forceActivationState(DISABLE_DEACTIVATION);
 			m_rigidBody->setCollisionFlags(
 				m_rigidBody->getCollisionFlags() | btCollisionObject::CF_KINEMATIC_OBJECT);
 			m_rigidBody->setMotionState(m_kinematicMotionState.get());
@@ -131,6 +211,25 @@ void RigidBody::SetActivation(const bool activation) const {
 		m_rigidBody->setMotionState(m_kinematicMotionState.get());
 }
 
+void RigidBody::SetSleeping(const bool allowSleeping) {
+	m_allowSleeping = allowSleeping && m_rigidBodyType != Operation::Static;
+	if (!m_allowSleeping)
+		m_rigidBody->forceActivationState(DISABLE_DEACTIVATION);
+	else if (!m_rigidBody->isKinematicObject())
+		m_rigidBody->forceActivationState(ACTIVE_TAG);
+}
+
+bool RigidBody::UpdateKinematicPosition(const float threshold) {
+	if (m_rigidBodyType != Operation::Static && !m_rigidBody->isKinematicObject())
+		return false;
+	const btVector3& origin = m_kinematicMotionState->m_transform.getOrigin();
+	const glm::vec3 position(origin.x(), origin.y(), origin.z());
+	const bool moved = glm::length(position - m_kinematicPosition) > threshold;
+	if (moved)
+		m_kinematicPosition = position;
+	return moved;
+}
+
 void RigidBody::ResetTransform() const {
 	if (m_activeMotionState)
 		m_activeMotionState->Reset();
@@ -146,23 +245,51 @@ void RigidBody::Reset(const Physics* physics) const {
 	m_rigidBody->clearForces();
 }
 
-void RigidBody::ReflectGlobalTransform() const {
-	if (m_activeMotionState)
-		m_activeMotionState->ReflectGlobalTransform();
-	if (m_kinematicMotionState)
-		m_kinematicMotionState->ReflectGlobalTransform();
+glm::mat4 RigidBody::GetGlobalTransform(const float alpha) const {
+	if (!m_rigidBody->isActive()) {
+		m_dynamicMotionState->m_prevTransform = m_dynamicMotionState->m_transform;
+		return m_dynamicMotionState->GetGlobalTransform(1.0f);
+	}
+	return m_dynamicMotionState->GetGlobalTransform(alpha);
 }
 
-void RigidBody::CalcLocalTransform() const {
-	if (m_node) {
-		if (const auto parent = m_node->m_parent) {
-			const auto local = glm::inverse(parent->m_global) * m_node->m_global;
-			m_node->m_local = local;
-		} else
-			m_node->m_local = m_node->m_global;
+void RigidBody::ReflectGlobalTransform(const float alpha, Skeleton& skeleton) const {
+	if (m_dynamicMotionState) {
+		skeleton.SetPhysicsGlobal(m_dynamicMotionState->m_node, GetGlobalTransform(alpha),
+			m_dynamicMotionState->m_boneMerge ? PhysicsWrite::Rotate : PhysicsWrite::Transform);
 	}
 }
 
+RigidBodyState RigidBody::GetState() const {
+	RigidBodyState state;
+	m_rigidBody->getWorldTransform().getOpenGLMatrix(&state.m_transform[0][0]);
+	const btVector3& linearVelocity = m_rigidBody->getLinearVelocity();
+	const btVector3& angularVelocity = m_rigidBody->getAngularVelocity();
+	state.m_linearVelocity = glm::vec3(linearVelocity.x(), linearVelocity.y(), linearVelocity.z());
+	state.m_angularVelocity = glm::vec3(angularVelocity.x(), angularVelocity.y(), angularVelocity.z());
+	return state;
+}
+
+void RigidBody::SetState(const RigidBodyState& state, const Physics* physics) const {
+	Reset(physics);
+	if (m_rigidBody->isKinematicObject())
+		return;
+	btTransform transform;
+	transform.setFromOpenGLMatrix(&state.m_transform[0][0]);
+	const btVector3 linearVelocity(state.m_linearVelocity.x, state.m_linearVelocity.y, state.m_linearVelocity.z);
+	const btVector3 angularVelocity(state.m_angularVelocity.x, state.m_angularVelocity.y, state.m_angularVelocity.z);
+	m_rigidBody->setWorldTransform(transform);
+	m_rigidBody->setInterpolationWorldTransform(transform);
+	m_rigidBody->setLinearVelocity(linearVelocity);
+	m_rigidBody->setAngularVelocity(angularVelocity);
+	m_rigidBody->setInterpolationLinearVelocity(linearVelocity);
+	m_rigidBody->setInterpolationAngularVelocity(angularVelocity);
+	if (m_activeMotionState)
+		m_activeMotionState->SetTransform(transform);
+	if (m_allowSleeping)
+		m_rigidBody->activate();
+}
+
 glm::mat4 RigidBody::GetTransform() const {
 	const btTransform transform = m_rigidBody->getCenterOfMassTransform();
 	glm::mat4 mat;
@@ -170,7 +297,51 @@ glm::mat4 RigidBody::GetTransform() const {
 	return Util::InvZ(mat);
 }
 
-void Joint::Create(const PMXReader::PMXJoint& pmxJoint, const RigidBody* rigidBodyA, const RigidBody* rigidBodyB) {
+btVector3 ToBtVector3(const glm::vec3& v) {
+	return { v.x, v.y, v.z };
+}
+
+bool IsLockedAxis(const float lower, const float upper) {
+	return std::abs(lower) < 1.0e-4f && std::abs(upper) < 1.0e-4f;
+}
+
+bool IsFreeAxis(const float lower, const float upper) {
+	return lower > upper || upper - lower >= glm::two_pi<float>();
+}
+
+JointType SimplifyJointType(const PMXReader::PMXJoint& pmxJoint, int& hingeAxis) {
+	if (pmxJoint.m_type != JointType::SpringDOF6 && pmxJoint.m_type != JointType::DOF6)
+		return pmxJoint.m_type;
+	for (int i = 0; i < 3; i++) {
+		if (!IsLockedAxis(pmxJoint.m_translateLowerLimit[i], pmxJoint.m_translateUpperLimit[i]))
+			return pmxJoint.m_type;
+	}
+	int freeCount = 0;
+	int lockedCount = 0;
+	int freeAxis = 2;
+	for (int i = 0; i < 3; i++) {
+		const float lower = pmxJoint.m_rotateLowerLimit[i];
+		const float upper = pmxJoint.m_rotateUpperLimit[i];
+		if (IsLockedAxis(lower, upper))
+			lockedCount++;
+		else {
+			if (pmxJoint.m_type == JointType::SpringDOF6 && pmxJoint.m_springRotateFactor[i] != 0.0f)
+				return pmxJoint.m_type;
+			if (IsFreeAxis(lower, upper))
+				freeCount++;
+			freeAxis = i;
+		}
+	}
+	if (freeCount == 3)
+		return JointType::P2P;
+	if (lockedCount == 2) {
+		hingeAxis = freeAxis;
+		return JointType::Hinge;
+	}
+	return pmxJoint.m_type;
+}
+
+void Joint::Create(const PMXReader::PMXJoint& pmxJoint, const RigidBody* rigidBodyA, const RigidBody* rigidBodyB, const JointMode mode) {
 	m_constraint = nullptr;
 	btMatrix3x3 rotMat;
 	rotMat.setEulerZYX(pmxJoint.m_rotate.x, pmxJoint.m_rotate.y, pmxJoint.m_rotate.z);
@@ -182,13 +353,12 @@ void Joint::Create(const PMXReader::PMXJoint& pmxJoint, const RigidBody* rigidBo
 	btTransform invB = rigidBodyB->m_rigidBody->getWorldTransform().inverse();
 	invA = invA * transform;
 	invB = invB * transform;
-	auto constraint = std::make_unique<btGeneric6DofSpringConstraint>(
-		*rigidBodyA->m_rigidBody, *rigidBodyB->m_rigidBody,
-		invA, invB, true);
-	constraint->setLinearLowerLimit(btVector3(pmxJoint.m_translateLowerLimit.x, pmxJoint.m_translateLowerLimit.y, pmxJoint.m_translateLowerLimit.z));
-	constraint->setLinearUpperLimit(btVector3(pmxJoint.m_translateUpperLimit.x, pmxJoint.m_translateUpperLimit.y, pmxJoint.m_translateUpperLimit.z));
-	constraint->setAngularLowerLimit(btVector3(pmxJoint.m_rotateLowerLimit.x, pmxJoint.m_rotateLowerLimit.y, pmxJoint.m_rotateLowerLimit.z));
-	constraint->setAngularUpperLimit(btVector3(pmxJoint.m_rotateUpperLimit.x, pmxJoint.m_rotateUpperLimit.y, pmxJoint.m_rotateUpperLimit.z));
+	btRigidBody& bodyA = *rigidBodyA->m_rigidBody;
+	btRigidBody& bodyB = *rigidBodyB->m_rigidBody;
+	const btVector3 linearLower = ToBtVector3(pmxJoint.m_translateLowerLimit);
+	const btVector3 linearUpper = ToBtVector3(pmxJoint.m_translateUpperLimit);
+	const btVector3 angularLower = ToBtVector3(pmxJoint.m_rotateLowerLimit);
+	const btVector3 angularUpper = ToBtVector3(pmxJoint.m_rotateUpperLimit);
 	const float stiffness[6] = {
 		pmxJoint.m_springTranslateFactor.x,
 		pmxJoint.m_springTranslateFactor.y,
@@ -197,13 +367,87 @@ void Joint::Create(const PMXReader::PMXJoint& pmxJoint, const RigidBody* rigidBo
 		pmxJoint.m_springRotateFactor.y,
 		pmxJoint.m_springRotateFactor.z,
 	};
-	for (int i = 0; i < 6; i++) {
-		if (stiffness[i] != 0.0f) {
-			constraint->enableSpring(i, true);
-			constraint->setStiffness(i, stiffness[i]);
+	JointType type = JointType::SpringDOF6;
+	int hingeAxis = 2;
+	if (mode != JointMode::Generic6DofSpring)
+		type = SimplifyJointType(pmxJoint, hingeAxis);
+	switch (type) {
+		case JointType::P2P:
+			m_constraint = std::make_unique<btPoint2PointConstraint>(bodyA, bodyB, invA.getOrigin(), invB.getOrigin());
+			break;
+		case JointType::Hinge: {
+			btMatrix3x3 axisRot = btMatrix3x3::getIdentity();
+			if (hingeAxis == 0)
+				axisRot.setEulerZYX(0, SIMD_HALF_PI, 0);
+			else if (hingeAxis == 1)
+				axisRot.setEulerZYX(-SIMD_HALF_PI, 0, 0);
+			const btTransform axisTransform(axisRot);
+			auto constraint = std::make_unique<btHingeConstraint>(bodyA, bodyB, invA * axisTransform, invB * axisTransform);
+			if (!IsFreeAxis(angularLower[hingeAxis], angularUpper[hingeAxis]))
+				constraint->setLimit(angularLower[hingeAxis], angularUpper[hingeAxis]);
+			m_constraint = std::move(constraint);
+			break;
+		}
+		case JointType::ConeTwist: {
+			auto constraint = std::make_unique<btConeTwistConstraint>(bodyA, bodyB, invA, invB);
+			constraint->setLimit(
+				glm::max(std::abs(angularLower.z()), std::abs(angularUpper.z())),
+				glm::max(std::abs(angularLower.y()), std::abs(angularUpper.y())),
+				glm::max(std::abs(angularLower.x()), std::abs(angularUpper.x())));
+			m_constraint = std::move(constraint);
+			break;
+		}
+		case JointType::Slider: {
+			auto constraint = std::make_unique<btSliderConstraint>(bodyA, bodyB, invA, invB, true);
+			constraint->setLowerLinLimit(linearLower.x());
+			constraint->setUpperLinLimit(linearUpper.x());
+			constraint->setLowerAngLimit(angularLower.x());
+			constraint->setUpperAngLimit(angularUpper.x());
+			m_constraint = std::move(constraint);
+			break;
+		}
+		case JointType::DOF6: {
+			auto constraint = std::make_unique<btGeneric6DofConstraint>(bodyA, bodyB, invA, invB, true);
+			constraint->setLinearLowerLimit(linearLower);
+			constraint->setLinearUpperLimit(linearUpper);
+			constraint->setAngularLowerLimit(angularLower);
+			constraint->setAngularUpperLimit(angularUpper);
+			m_constraint = std::move(constraint);
+			break;
 		}
+		case JointType::SpringDOF6:
+		default:
+			if (mode == JointMode::TypedSpring2) {
+				auto constraint = std::make_unique<btGeneric6DofSpring2Constraint>(bodyA, bodyB, invA, invB);
+				constraint->setLinearLowerLimit(linearLower);
+				constraint->setLinearUpperLimit(linearUpper);
+				constraint->setAngularLowerLimit(angularLower);
+				constraint->setAngularUpperLimit(angularUpper);
+				for (int i = 0; i < 6; i++) {
+					if (stiffness[i] != 0.0f) {
+						constraint->enableSpring(i, true);
+						constraint->setStiffness(i, stiffness[i], true);
+						constraint->setDamping(i, 0.0f, true);
+					}
+				}
+				constraint->setEquilibriumPoint();
+				m_constraint = std::move(constraint);
+			} else {
+				auto constraint = std::make_unique<btGeneric6DofSpringConstraint>(bodyA, bodyB, invA, invB, true);
+				constraint->setLinearLowerLimit(linearLower);
+				constraint->setLinearUpperLimit(linearUpper);
+				constraint->setAngularLowerLimit(angularLower);
+				constraint->setAngularUpperLimit(angularUpper);
+				for (int i = 0; i < 6; i++) {
+					if (stiffness[i] != 0.0f) {
+						constraint->enableSpring(i, true);
+						constraint->setStiffness(i, stiffness[i]);
+					}
+				}
+				m_constraint = std::move(constraint);
+			}
+			break;
 	}
-	m_constraint = std::move(constraint);
 }
 
 Physics::~Physics() {
@@ -214,14 +458,30 @@ Physics::~Physics() {
 void Physics::Create() {
 	m_broadPhase = std::make_unique<btDbvtBroadphase>();
 	m_collisionConfig = std::make_unique<btDefaultCollisionConfiguration>();
-	m_dispatcher = std::make_unique<btCollisionDispatcher>(m_collisionConfig.get());
-	m_solver = std::make_unique<btSequentialImpulseConstraintSolver>();
-	m_world = std::make_unique<btDiscreteDynamicsWorld>(
-		m_dispatcher.get(),
-		m_broadPhase.get(),
-		m_solver.get(),
-		m_collisionConfig.get()
-	);
+	if (m_multiThreaded) {
+		static JobPoolTaskScheduler scheduler;
+		if (btGetTaskScheduler() != &scheduler)
+			btSetTaskScheduler(&scheduler);
+		m_dispatcher = std::make_unique<btCollisionDispatcherMt>(m_collisionConfig.get());
+		m_solver = std::make_unique<btSequentialImpulseConstraintSolverMt>();
+		m_solverPool = std::make_unique<btConstraintSolverPoolMt>(scheduler.getNumThreads());
+		m_world = std::make_unique<btDiscreteDynamicsWorldMt>(
+			m_dispatcher.get(),
+			m_broadPhase.get(),
+			m_solverPool.get(),
+			m_solver.get(),
+			m_collisionConfig.get()
+		);
+	} else {
+		m_dispatcher = std::make_unique<btCollisionDispatcher>(m_collisionConfig.get());
+		m_solver = std::make_unique<btSequentialImpulseConstraintSolver>();
+		m_world = std::make_unique<btDiscreteDynamicsWorld>(
+			m_dispatcher.get(),
+			m_broadPhase.get(),
+			m_solver.get(),
+			m_collisionConfig.get()
+		);
+	}
 	m_world->setGravity(btVector3(0, -9.8f * 10.0f, 0));
 	m_groundShape = std::make_unique<btStaticPlaneShape>(btVector3(0, 1, 0), 0.0f);
 	btTransform groundTransform;
@@ -229,9 +489,61 @@ void Physics::Create() {
 	m_groundMS = std::make_unique<btDefaultMotionState>(groundTransform);
 	btRigidBody::btRigidBodyConstructionInfo groundInfo(0, m_groundMS.get(), m_groundShape.get(), btVector3(0, 0, 0));
 	m_groundRB = std::make_unique<btRigidBody>(groundInfo);
-	m_world->addRigidBody(m_groundRB.get());
+	m_world->addRigidBody(m_groundRB.get(), NonFilterGroup, btBroadphaseProxy::AllFilter);
 	auto filterCB = std::make_unique<OverlapFilterCallback>();
-	filterCB->m_nonFilterProxy.push_back(m_groundRB->getBroadphaseProxy());
+	filterCB->m_interModelCollision = m_interModelCollision;
 	m_world->getPairCache()->setOverlapFilterCallback(filterCB.get());
 	m_filterCB = std::move(filterCB);
 }
+
+uint16_t Physics::AddModel() {
+	if (!m_freeModelSlots.empty()) {
+		const uint16_t slot = m_freeModelSlots.back();
+		m_freeModelSlots.pop_back();
+		return slot;
+	}
+	const uint16_t slot = m_nextModelSlot;
+	m_nextModelSlot = static_cast<uint16_t>((m_nextModelSlot + 1) & ModelSlotMask);
+	return slot;
+}
+
+void Physics::RemoveModel(const uint16_t slot) {
+	m_freeModelSlots.push_back(slot);
+}
+
+void Physics::Step(const float elapsed) {
+	const auto timeStep = static_cast<float>(1.0 / m_fps);
+	if (!m_fixedTimeStep) {
+		m_world->stepSimulation(elapsed, m_maxSubStepCount, timeStep);
+		return;
+	}
+	m_accumulator += elapsed;
+	m_stepCount = 0;
+	while (m_accumulator >= timeStep && m_stepCount < m_maxStepCount) {
+		m_world->stepSimulation(timeStep, 0, timeStep);
+		m_accumulator -= timeStep;
+		m_stepCount++;
+	}
+	if (m_accumulator >= timeStep)
+		m_accumulator = std::fmod(m_accumulator, timeStep);
+	m_alpha = m_accumulator / timeStep;
+}
+
+void Physics::StepReduced(const float elapsed) const {
+	m_world->stepSimulation(elapsed, m_reducedSubStepCount, static_cast<btScalar>(1.0 / m_reducedFps));
+}
+
+void Physics::StepReset() {
+	m_world->stepSimulation(1.0f / 60.0f, m_maxSubStepCount, static_cast<btScalar>(1.0 / m_fps));
+	ResetTimeStep();
+}
+
+void Physics::ResetTimeStep() {
+	m_accumulator = 0;
+	m_alpha = 1;
+	m_stepCount = 0;
+}
+
+int Physics::MakeFilterGroup(const uint16_t group, const uint16_t modelSlot) {
+	return group | (modelSlot & ModelSlotMask) << ModelSlotShift;
+}
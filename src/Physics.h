@@ -1,22 +1,45 @@
 ﻿#pragma once
 
+#include <map>
+#include <mutex>
+#include <tuple>
 #include <vector>
 #include <btBulletDynamicsCommon.h>
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <BulletDynamics/ConstraintSolver/btGeneric6DofSpring2Constraint.h>
+#include <BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#include <LinearMath/btThreads.h>
 
 #include "Reader.h"
 
 struct Physics;
 class Model;
 struct Node;
+struct Skeleton;
 
 class MotionState : public btMotionState {
 public:
 	virtual void Reset() {}
-	virtual void ReflectGlobalTransform() {}
+	virtual void SetTransform(const btTransform& transform) {}
+};
+
+class JobPoolTaskScheduler final : public btITaskScheduler {
+public:
+	JobPoolTaskScheduler();
+
+	int getMaxNumThreads() const override;
+	int getNumThreads() const override { return m_numThreads; }
+	void setNumThreads(int numThreads) override;
+	void parallelFor(int iBegin, int iEnd, int grainSize, const btIParallelForBody& body) override;
+	btScalar parallelSum(int iBegin, int iEnd, int grainSize, const btIParallelSumBody& body) override;
+
+private:
+	int m_numThreads;
 };
 
 struct OverlapFilterCallback final : btOverlapFilterCallback {
-	std::vector<btBroadphaseProxy*> m_nonFilterProxy;
+	bool m_interModelCollision = false;
 
 	bool needBroadphaseCollision(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1) const override;
 };
@@ -31,32 +54,26 @@ public:
 	void getWorldTransform(btTransform& worldTransform) const override { worldTransform = m_transform; }
 	void setWorldTransform(const btTransform& worldTransform) override { m_transform = worldTransform; }
 	void Reset() override { m_transform = m_initialTransform; }
+	void SetTransform(const btTransform& transform) override { m_transform = transform; }
 };
 
-class DynamicMotionState : public MotionState {
+class DynamicMotionState final : public MotionState {
 public:
-	DynamicMotionState(Node* node, const glm::mat4& offset);
+	DynamicMotionState(Node* node, const glm::mat4& offset, bool boneMerge);
 
 	Node*		m_node;
 	glm::mat4	m_offset;
+	glm::mat4	m_btOffset;
 	glm::mat4	m_invOffset = glm::mat4(1);
 	btTransform	m_transform;
+	btTransform	m_prevTransform;
+	bool		m_boneMerge;
 
 	void getWorldTransform(btTransform& worldTransform) const override { worldTransform = m_transform; }
-	void setWorldTransform(const btTransform& worldTransform) override { m_transform = worldTransform; }
+	void setWorldTransform(const btTransform& worldTransform) override;
 	void Reset() override;
-	void ReflectGlobalTransform() override;
-
-protected:
-	virtual void PostProcessBtGlobal(glm::mat4& btGlobal) const {}
-};
-
-class DynamicAndBoneMergeMotionState final : public DynamicMotionState {
-public:
-	using DynamicMotionState::DynamicMotionState;
-
-protected:
-	void PostProcessBtGlobal(glm::mat4& btGlobal) const override;
+	void SetTransform(const btTransform& transform) override;
+	glm::mat4 GetGlobalTransform(float alpha) const;
 };
 
 class KinematicMotionState final : public MotionState {
@@ -65,36 +82,70 @@ public:
 
 	Node*		m_node;
 	glm::mat4	m_offset;
+	glm::mat4	m_btOffset;
+	btTransform	m_transform;
 
-	void getWorldTransform(btTransform& worldTransform) const override;
+	void getWorldTransform(btTransform& worldTransform) const override { worldTransform = m_transform; }
 	void setWorldTransform(const btTransform& worldTransform) override {}
+	void UpdateTransform();
+};
+
+struct CollisionShapeCache {
+	std::map<std::tuple<Shape, float, float, float>, std::weak_ptr<btCollisionShape>>	m_shapes;
+	std::mutex	m_mutex;
+
+	static CollisionShapeCache& Get();
+	std::shared_ptr<btCollisionShape> GetShape(Shape shape, const glm::vec3& size);
+	void Prune();
+	size_t GetShapeCount();
+};
+
+enum class JointMode : uint8_t {
+	Generic6DofSpring,
+	Typed,
+	TypedSpring2
+};
+
+struct RigidBodyState {
+	glm::mat4	m_transform;
+	glm::vec3	m_linearVelocity;
+	glm::vec3	m_angularVelocity;
 };
 
 struct RigidBody {
-	std::unique_ptr<btCollisionShape>	m_shape;
-	std::unique_ptr<MotionState>		m_activeMotionState;
-	std::unique_ptr<MotionState>		m_kinematicMotionState;
-	std::unique_ptr<btRigidBody>		m_rigidBody;
+	std::shared_ptr<btCollisionShape>		m_shape;
+	std::unique_ptr<MotionState>			m_activeMotionState;
+	std::unique_ptr<KinematicMotionState>	m_kinematicMotionState;
+	DynamicMotionState*						m_dynamicMotionState = nullptr;
+	std::unique_ptr<btRigidBody>			m_rigidBody;
 	Operation	m_rigidBodyType = Operation::Static;
 	uint16_t	m_group = 0;
 	uint16_t	m_groupMask = 0;
 	Node*		m_node = nullptr;
 	glm::mat4	m_offsetMat = glm::mat4(1);
 	std::string	m_name;
+	bool		m_allowSleeping = false;
+	glm::vec3	m_kinematicPosition = glm::vec3(0);
 
-	void Create(const PMXReader::PMXRigidbody& pmxRigidBody, const Model* model, Node* node);
+	void Create(const PMXReader::PMXRigidbody& pmxRigidBody, Model* model, Node* node);
 	void SetActivation(bool activation) const;
+	void SetSleeping(bool allowSleeping);
+	bool IsKinematic(bool activation) const { return m_rigidBodyType == Operation::Static || !activation; }
+	void UpdateKinematicTransform() const { m_kinematicMotionState->UpdateTransform(); }
+	bool UpdateKinematicPosition(float threshold);
 	void ResetTransform() const;
 	void Reset(const Physics* physics) const;
-	void ReflectGlobalTransform() const;
-	void CalcLocalTransform() const;
+	glm::mat4 GetGlobalTransform(float alpha) const;
+	void ReflectGlobalTransform(float alpha, Skeleton& skeleton) const;
+	RigidBodyState GetState() const;
+	void SetState(const RigidBodyState& state, const Physics* physics) const;
 	glm::mat4 GetTransform() const;
 };
 
 struct Joint {
 	std::unique_ptr<btTypedConstraint>	m_constraint;
 
-	void Create(const PMXReader::PMXJoint& pmxJoint, const RigidBody* rigidBodyA, const RigidBody* rigidBodyB);
+	void Create(const PMXReader::PMXJoint& pmxJoint, const RigidBody* rigidBodyA, const RigidBody* rigidBodyB, JointMode mode);
 };
 
 struct Physics {
@@ -104,13 +155,37 @@ struct Physics {
 	std::unique_ptr<btDefaultCollisionConfiguration>		m_collisionConfig;
 	std::unique_ptr<btCollisionDispatcher>					m_dispatcher;
 	std::unique_ptr<btSequentialImpulseConstraintSolver>	m_solver;
+	std::unique_ptr<btConstraintSolverPoolMt>				m_solverPool;
 	std::unique_ptr<btDiscreteDynamicsWorld>				m_world;
 	std::unique_ptr<btCollisionShape>						m_groundShape;
 	std::unique_ptr<btMotionState>							m_groundMS;
 	std::unique_ptr<btRigidBody>							m_groundRB;
 	std::unique_ptr<btOverlapFilterCallback>				m_filterCB;
-	double	m_fps = 120.0f;
-	int		m_maxSubStepCount = 10;
+	double		m_fps = 120.0f;
+	int			m_maxSubStepCount = 10;
+	bool		m_multiThreaded = false;
+	bool		m_interModelCollision = false;
+	uint16_t	m_nextModelSlot = 0;
+	std::vector<uint16_t>	m_freeModelSlots;
+	bool		m_fixedTimeStep = false;
+	int			m_maxStepCount = 4;
+	float		m_accumulator = 0;
+	float		m_alpha = 1;
+	int			m_stepCount = 0;
+	double		m_reducedFps = 60.0;
+	int			m_reducedSubStepCount = 2;
+
+	static constexpr int	ModelSlotShift = 16;
+	static constexpr int	ModelSlotMask = 0x3FFF;
+	static constexpr int	GroupMask = 0xFFFF;
+	static constexpr int	NonFilterGroup = 1 << 30;
 
 	void Create();
+	uint16_t AddModel();
+	void RemoveModel(uint16_t slot);
+	void Step(float elapsed);
+	void StepReduced(float elapsed) const;
+	void StepReset();
+	void ResetTimeStep();
+	static int MakeFilterGroup(uint16_t group, uint16_t modelSlot);
 };
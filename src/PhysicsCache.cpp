@@ -0,0 +1,281 @@
+﻿#include "PhysicsCache.h"
+
+#include "Animation.h"
+#include "Model.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <ranges>
+#include <sstream>
+
+constexpr char		PhysicsCacheMagic[4] = { 'P', 'H', 'Y', 'C' };
+constexpr uint32_t	PhysicsCacheVersion = 2;
+constexpr char		PhysicsTrackMagic[4] = { 'P', 'H', 'Y', 'T' };
+constexpr uint32_t	PhysicsTrackVersion = 2;
+
+template <class T>
+void WriteData(std::ostream& os, const T* src, const size_t count = 1) {
+	os.write(reinterpret_cast<const char*>(src), static_cast<std::streamsize>(sizeof(T) * count));
+}
+
+template <class T>
+bool ReadData(std::istream& is, T* dst, const size_t count = 1) {
+	is.read(reinterpret_cast<char*>(dst), static_cast<std::streamsize>(sizeof(T) * count));
+	return static_cast<bool>(is);
+}
+
+template <class T>
+void WriteVector(std::ostream& os, const std::vector<T>& values) {
+	const auto count = static_cast<uint32_t>(values.size());
+	WriteData(os, &count);
+	WriteData(os, values.data(), values.size());
+}
+
+bool HasBytes(std::istream& is, const size_t size) {
+	const auto pos = is.tellg();
+	if (pos < 0 || !is.seekg(0, std::ios::end))
+		return false;
+	const auto end = is.tellg();
+	is.seekg(pos);
+	return end >= pos && static_cast<uint64_t>(end - pos) >= size;
+}
+
+template <class T>
+bool ReadVector(std::istream& is, std::vector<T>& values) {
+	uint32_t count = 0;
+	if (!ReadData(is, &count) || !HasBytes(is, sizeof(T) * count))
+		return false;
+	values.resize(count);
+	return ReadData(is, values.data(), values.size());
+}
+
+void HashBytes(uint64_t& hash, const void* data, const size_t size) {
+	const auto* bytes = static_cast<const uint8_t*>(data);
+	for (size_t i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 0x100000001B3ull;
+	}
+}
+
+void HashFile(uint64_t& hash, const std::filesystem::path& path) {
+	std::error_code ec;
+	const std::wstring name = std::filesystem::absolute(path, ec).lexically_normal().wstring();
+	HashBytes(hash, name.data(), name.size() * sizeof(wchar_t));
+	const uintmax_t size = std::filesystem::file_size(path, ec);
+	HashBytes(hash, &size, sizeof(size));
+	const auto writeTime = std::filesystem::last_write_time(path, ec).time_since_epoch().count();
+	HashBytes(hash, &writeTime, sizeof(writeTime));
+}
+
+void HashPhysicsSettings(uint64_t& hash, const Model& model) {
+	const uint8_t settings[] = {
+		static_cast<uint8_t>(model.m_jointMode),
+		static_cast<uint8_t>(model.m_fixedTimeStepPhysics),
+		static_cast<uint8_t>(model.m_multiThreadedPhysics),
+		static_cast<uint8_t>(model.m_fastPhysicsWarmUp),
+		static_cast<uint8_t>(model.m_useSpringBones)
+	};
+	HashBytes(hash, settings, sizeof(settings));
+	const int32_t maxStepCount = model.m_maxPhysicsStepCount;
+	HashBytes(hash, &maxStepCount, sizeof(maxStepCount));
+	HashBytes(hash, &PhysicsCacheVersion, sizeof(PhysicsCacheVersion));
+}
+
+uint64_t PhysicsCache::MakeKey(const Model& model,
+	const std::filesystem::path& modelPath,
+	const std::vector<std::filesystem::path>& animPaths) {
+	uint64_t hash = 0xCBF29CE484222325ull;
+	HashPhysicsSettings(hash, model);
+	HashFile(hash, modelPath);
+	for (const auto& animPath : animPaths)
+		HashFile(hash, animPath);
+	return hash;
+}
+
+std::filesystem::path PhysicsCache::MakePath(const std::filesystem::path& cacheDir,
+	const Model& model,
+	const std::filesystem::path& modelPath,
+	const std::vector<std::filesystem::path>& animPaths) {
+	std::stringstream ss;
+	ss << std::hex << std::setfill('0') << std::setw(16) << MakeKey(model, modelPath, animPaths) << ".phys";
+	return cacheDir / ss.str();
+}
+
+bool PhysicsCache::Load() {
+	m_snapshots.clear();
+	std::ifstream is(m_path, std::ios::binary);
+	if (!is)
+		return false;
+	char magic[4];
+	uint32_t version = 0;
+	uint32_t snapshotCount = 0;
+	if (!ReadData(is, magic, 4) || !std::equal(magic, magic + 4, PhysicsCacheMagic))
+		return false;
+	if (!ReadData(is, &version) || version != PhysicsCacheVersion)
+		return false;
+	if (!ReadData(is, &snapshotCount))
+		return false;
+	for (uint32_t i = 0; i < snapshotCount; i++) {
+		PhysicsSnapshot snapshot;
+		if (!ReadData(is, &snapshot.m_frame) ||
+		    !ReadVector(is, snapshot.m_rigidBodies) ||
+		    !ReadVector(is, snapshot.m_springPositions) ||
+		    !ReadVector(is, snapshot.m_springPrevPositions)) {
+			m_snapshots.clear();
+			return false;
+		}
+		m_snapshots[snapshot.m_frame] = std::move(snapshot);
+	}
+	return true;
+}
+
+bool PhysicsCache::Save() const {
+	if (m_path.empty())
+		return false;
+	std::error_code ec;
+	std::filesystem::create_directories(m_path.parent_path(), ec);
+	std::ofstream os(m_path, std::ios::binary | std::ios::trunc);
+	if (!os)
+		return false;
+	const auto snapshotCount = static_cast<uint32_t>(m_snapshots.size());
+	WriteData(os, PhysicsCacheMagic, 4);
+	WriteData(os, &PhysicsCacheVersion);
+	WriteData(os, &snapshotCount);
+	for (const auto& snapshot : m_snapshots | std::views::values) {
+		WriteData(os, &snapshot.m_frame);
+		WriteVector(os, snapshot.m_rigidBodies);
+		WriteVector(os, snapshot.m_springPositions);
+		WriteVector(os, snapshot.m_springPrevPositions);
+	}
+	return static_cast<bool>(os);
+}
+
+void PhysicsCache::Clear() {
+	m_snapshots.clear();
+	std::error_code ec;
+	if (!m_path.empty())
+		std::filesystem::remove(m_path, ec);
+}
+
+const PhysicsSnapshot* PhysicsCache::Find(const int32_t frame) const {
+	const auto it = m_snapshots.find(frame);
+	return it != m_snapshots.end() ? &it->second : nullptr;
+}
+
+const PhysicsSnapshot* PhysicsCache::FindNearest(const int32_t frame) const {
+	auto it = m_snapshots.upper_bound(frame);
+	if (it == m_snapshots.begin())
+		return nullptr;
+	return &(--it)->second;
+}
+
+void PhysicsCache::Store(PhysicsSnapshot snapshot) {
+	const int32_t frame = snapshot.m_frame;
+	m_snapshots[frame] = std::move(snapshot);
+}
+
+bool PhysicsTrack::Bake(const Animation& anim, const float fps) {
+	Model& model = *anim.m_model;
+	if (fps <= 0.0f || model.m_nodes.empty())
+		return false;
+	m_fps = fps;
+	m_boneCount = static_cast<uint32_t>(model.m_nodes.size());
+	m_frameCount = 0;
+	m_nodeIndices.clear();
+	m_translates.clear();
+	m_rotates.clear();
+	model.GetPhysicsNodes(m_nodeIndices);
+	if (m_nodeIndices.empty())
+		return false;
+	const bool useBakedPhysics = model.m_useBakedPhysics;
+	model.m_useBakedPhysics = false;
+	const float duration = static_cast<float>(anim.GetMaxFrame()) / 30.0f;
+	const auto frameCount = static_cast<uint32_t>(duration * fps) + 1;
+	m_translates.reserve(static_cast<size_t>(frameCount) * m_nodeIndices.size());
+	m_rotates.reserve(static_cast<size_t>(frameCount) * m_nodeIndices.size());
+	anim.SyncPhysics(0.0f);
+	Record(model);
+	for (uint32_t i = 1; i < frameCount; i++) {
+		model.BeginAnimation();
+		model.UpdateAllAnimation(&anim, static_cast<float>(i) * 30.0f / fps, 1.0f / fps);
+		Record(model);
+	}
+	model.m_useBakedPhysics = useBakedPhysics;
+	return true;
+}
+
+bool PhysicsTrack::Load(const std::filesystem::path& path) {
+	m_frameCount = 0;
+	m_nodeIndices.clear();
+	m_translates.clear();
+	m_rotates.clear();
+	std::ifstream is(path, std::ios::binary);
+	if (!is)
+		return false;
+	char magic[4];
+	uint32_t version = 0;
+	if (!ReadData(is, magic, 4) || !std::equal(magic, magic + 4, PhysicsTrackMagic))
+		return false;
+	if (!ReadData(is, &version) || version != PhysicsTrackVersion)
+		return false;
+	if (!ReadData(is, &m_key) || !ReadData(is, &m_fps) || !ReadData(is, &m_boneCount) || !ReadData(is, &m_frameCount) ||
+	    !ReadVector(is, m_nodeIndices) || !ReadVector(is, m_translates) || !ReadVector(is, m_rotates)) {
+		m_frameCount = 0;
+		return false;
+	}
+	const size_t sampleCount = static_cast<size_t>(m_frameCount) * m_nodeIndices.size();
+	if (m_fps <= 0.0f || m_translates.size() != sampleCount || m_rotates.size() != sampleCount) {
+		m_frameCount = 0;
+		return false;
+	}
+	return true;
+}
+
+bool PhysicsTrack::Save(const std::filesystem::path& path) const {
+	std::ofstream os(path, std::ios::binary | std::ios::trunc);
+	if (!os)
+		return false;
+	WriteData(os, PhysicsTrackMagic, 4);
+	WriteData(os, &PhysicsTrackVersion);
+	WriteData(os, &m_key);
+	WriteData(os, &m_fps);
+	WriteData(os, &m_boneCount);
+	WriteData(os, &m_frameCount);
+	WriteVector(os, m_nodeIndices);
+	WriteVector(os, m_translates);
+	WriteVector(os, m_rotates);
+	return static_cast<bool>(os);
+}
+
+bool PhysicsTrack::IsCompatible(const Model& model, const uint64_t key) const {
+	if (m_frameCount == 0 || m_key != key || m_boneCount != model.m_nodes.size())
+		return false;
+	return std::ranges::all_of(m_nodeIndices, [this](const uint32_t index) { return index < m_boneCount; });
+}
+
+void PhysicsTrack::Record(const Model& model) {
+	for (const uint32_t index : m_nodeIndices) {
+		const glm::mat4& local = model.m_nodes[index].GetLocal();
+		m_translates.emplace_back(local[3]);
+		m_rotates.push_back(glm::normalize(glm::quat_cast(glm::mat3(local))));
+	}
+	m_frameCount++;
+}
+
+void PhysicsTrack::Sample(const float time, Model& model) const {
+	if (m_frameCount == 0)
+		return;
+	const float frame = glm::clamp(time * m_fps, 0.0f, static_cast<float>(m_frameCount - 1));
+	const auto frame0 = static_cast<uint32_t>(frame);
+	const uint32_t frame1 = glm::min(frame0 + 1, m_frameCount - 1);
+	const float alpha = frame - static_cast<float>(frame0);
+	const size_t nodeCount = m_nodeIndices.size();
+	const size_t offset0 = frame0 * nodeCount;
+	const size_t offset1 = frame1 * nodeCount;
+	for (size_t i = 0; i < nodeCount; i++) {
+		const glm::vec3 translate = glm::mix(m_translates[offset0 + i], m_translates[offset1 + i], alpha);
+		const glm::quat rotate = glm::slerp(m_rotates[offset0 + i], m_rotates[offset1 + i], alpha);
+		model.m_nodes[m_nodeIndices[i]].GetLocal() = glm::translate(glm::mat4(1), translate) * glm::mat4_cast(rotate);
+	}
+}
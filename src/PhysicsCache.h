@@ -0,0 +1,52 @@
+﻿#pragma once
+
+#include <filesystem>
+#include <map>
+
+#include "Physics.h"
+
+struct Animation;
+class Model;
+
+struct PhysicsSnapshot {
+	int32_t						m_frame = 0;
+	std::vector<RigidBodyState>	m_rigidBodies;
+	std::vector<glm::vec3>		m_springPositions;
+	std::vector<glm::vec3>		m_springPrevPositions;
+};
+
+struct PhysicsCache {
+	std::filesystem::path				m_path;
+	std::map<int32_t, PhysicsSnapshot>	m_snapshots;
+
+	static uint64_t MakeKey(const Model& model,
+		const std::filesystem::path& modelPath,
+		const std::vector<std::filesystem::path>& animPaths);
+	static std::filesystem::path MakePath(const std::filesystem::path& cacheDir,
+		const Model& model,
+		const std::filesystem::path& modelPath,
+		const std::vector<std::filesystem::path>& animPaths);
+	bool Load();
+	bool Save() const;
+	void Clear();
+	const PhysicsSnapshot* Find(int32_t frame) const;
+	const PhysicsSnapshot* FindNearest(int32_t frame) const;
+	void Store(PhysicsSnapshot snapshot);
+};
+
+struct PhysicsTrack {
+	uint64_t				m_key = 0;
+	float					m_fps = 30.0f;
+	uint32_t				m_boneCount = 0;
+	uint32_t				m_frameCount = 0;
+	std::vector<uint32_t>	m_nodeIndices;
+	std::vector<glm::vec3>	m_translates;
+	std::vector<glm::quat>	m_rotates;
+
+	bool Bake(const Animation& anim, float fps);
+	bool Load(const std::filesystem::path& path);
+	bool Save(const std::filesystem::path& path) const;
+	bool IsCompatible(const Model& model, uint64_t key) const;
+	void Record(const Model& model);
+	void Sample(float time, Model& model) const;
+};
@@ -0,0 +1,72 @@
+﻿#include "PhysicsPipeline.h"
+
+#include <cassert>
+
+PhysicsPipeline::~PhysicsPipeline() {
+	Stop();
+}
+
+void PhysicsPipeline::Start(std::function<void(PhysicsFrame&)> step) {
+	Stop();
+	m_step = std::move(step);
+	m_submitted = 0;
+	m_completed = 0;
+	m_consumed = 0;
+	m_stop = false;
+	m_thread = std::thread([this] { WorkerLoop(); });
+}
+
+void PhysicsPipeline::Stop() {
+	if (!m_thread.joinable())
+		return;
+	WaitCompleted(m_submitted.load(std::memory_order_relaxed));
+	m_stop.store(true, std::memory_order_relaxed);
+	m_submitted.fetch_add(1, std::memory_order_release);
+	m_submitted.notify_one();
+	m_thread.join();
+	m_submitted = m_consumed = m_completed.load(std::memory_order_relaxed);
+}
+
+void PhysicsPipeline::Submit(const float elapsed) {
+	const uint64_t frame = m_submitted.load(std::memory_order_relaxed) + 1;
+	assert(m_consumed == frame - 1);
+	WaitCompleted(frame - 1);
+	auto& submitFrame = m_frames[frame & 1];
+	submitFrame.m_elapsed = elapsed;
+	submitFrame.m_submitTime = std::chrono::steady_clock::now();
+	m_submitted.store(frame, std::memory_order_release);
+	m_submitted.notify_one();
+}
+
+const PhysicsFrame* PhysicsPipeline::Wait() {
+	const uint64_t frame = m_submitted.load(std::memory_order_relaxed);
+	if (frame == m_consumed)
+		return nullptr;
+	const auto start = std::chrono::steady_clock::now();
+	WaitCompleted(frame);
+	m_waitTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	m_consumed = frame;
+	return &m_frames[frame & 1];
+}
+
+void PhysicsPipeline::WorkerLoop() {
+	uint64_t completed = m_completed.load(std::memory_order_relaxed);
+	while (true) {
+		m_submitted.wait(completed, std::memory_order_acquire);
+		if (m_stop.load(std::memory_order_relaxed))
+			return;
+		const uint64_t frame = m_submitted.load(std::memory_order_acquire);
+		m_step(m_frames[frame & 1]);
+		completed = frame;
+		m_completed.store(frame, std::memory_order_release);
+		m_completed.notify_one();
+	}
+}
+
+void PhysicsPipeline::WaitCompleted(const uint64_t frame) const {
+	uint64_t completed = m_completed.load(std::memory_order_acquire);
+	while (completed < frame) {
+		m_completed.wait(completed, std::memory_order_acquire);
+		completed = m_completed.load(std::memory_order_acquire);
+	}
+}
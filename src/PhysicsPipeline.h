@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include <glm/mat4x4.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+
+struct PhysicsFrame {
+	float									m_elapsed = 0;
+	double									m_stepTime = 0;
+	std::chrono::steady_clock::time_point	m_submitTime;
+	std::vector<glm::mat4>					m_globals;
+};
+
+struct PhysicsPipeline {
+	~PhysicsPipeline();
+
+	std::function<void(PhysicsFrame&)>	m_step;
+	std::thread							m_thread;
+	PhysicsFrame						m_frames[2];
+	std::atomic<uint64_t>				m_submitted = 0;
+	std::atomic<uint64_t>				m_completed = 0;
+	std::atomic<bool>					m_stop = false;
+	uint64_t							m_consumed = 0;
+	double								m_waitTime = 0;
+
+	void Start(std::function<void(PhysicsFrame&)> step);
+	void Stop();
+	void Submit(float elapsed);
+	const PhysicsFrame* Wait();
+
+private:
+	void WorkerLoop();
+	void WaitCompleted(uint64_t frame) const;
+};
@@ -61,9 +61,9 @@ void PMXReader::ReadString(std::istream& is, std::string* val) const {
 	Read(is, &bufSize);
 	if (bufSize > 0) {
 		if (m_header.m_encodeType == EncodeType::UTF16) {
-			std::wstring utf16Str(bufSize / 2, L'\0');
+			std::u16string utf16Str(bufSize / 2, u'\0');
 			Read(is, utf16Str.data(), bufSize);
-			*val = Util::WStringToUtf8(utf16Str);
+			*val = Util::Utf16ToUtf8(utf16Str);
 		} else if (m_header.m_encodeType == EncodeType::UTF8) {
 			val->resize(bufSize);
 			Read(is, val->data(), bufSize);
@@ -0,0 +1,199 @@
+﻿#include "Skeleton.h"
+#include "IkSolver.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+bool IsAncestor(const Node* ancestor, const Node* node) {
+	for (; node; node = node->m_parent) {
+		if (node == ancestor)
+			return true;
+	}
+	return false;
+}
+
+bool WritesRead(const IkSolver* writer, const IkSolver* reader) {
+	const auto writes = [writer](const Node* node) {
+		if (IsAncestor(writer->m_ikNode, node))
+			return true;
+		return std::ranges::any_of(writer->m_chains, [node](const IKChain& chain) {
+			return IsAncestor(chain.m_node, node);
+		});
+	};
+	if (writes(reader->m_ikNode) || writes(reader->m_ikTarget))
+		return true;
+	return std::ranges::any_of(reader->m_chains, [&writes](const IKChain& chain) {
+		return writes(chain.m_node);
+	});
+}
+
+bool IsIndependent(const std::vector<Node*>& group, const Node* ikNode) {
+	return std::ranges::none_of(group, [ikNode](const Node* other) {
+		return WritesRead(other->m_ikSolver, ikNode->m_ikSolver) || WritesRead(ikNode->m_ikSolver, other->m_ikSolver);
+	});
+}
+
+void NodeSchedule::Create(const std::vector<Node*>& sortedNodes, const bool afterPhysics) {
+	m_nodes.clear();
+	m_roots.clear();
+	m_stages.clear();
+	std::unordered_map<const Node*, size_t> writeLevels;
+	std::unordered_map<const Node*, size_t> readLevels;
+	for (auto* node : sortedNodes) {
+		if (node->m_isDeformAfterPhysics != afterPhysics)
+			continue;
+		m_nodes.push_back(node);
+		if (!node->m_parent)
+			m_roots.push_back(node);
+		if (node->m_appendNode) {
+			if (m_stages.empty() || !m_stages.back().m_ikNodes.empty()) {
+				m_stages.emplace_back();
+				writeLevels.clear();
+				readLevels.clear();
+			}
+			size_t level = 0;
+			if (const auto it = writeLevels.find(node->m_appendNode); it != writeLevels.end())
+				level = it->second + 1;
+			if (const auto it = readLevels.find(node); it != readLevels.end())
+				level = std::max(level, it->second + 1);
+			writeLevels[node] = level;
+			auto& readLevel = readLevels[node->m_appendNode];
+			readLevel = std::max(readLevel, level);
+			auto& levels = m_stages.back().m_appendLevels;
+			if (levels.size() <= level)
+				levels.resize(level + 1);
+			levels[level].push_back(node);
+		}
+		if (node->m_ikSolver) {
+			if (m_stages.empty() || m_stages.back().m_ikNodes.empty() || !IsIndependent(m_stages.back().m_ikNodes, node))
+				m_stages.emplace_back();
+			m_stages.back().m_ikNodes.push_back(node);
+		}
+	}
+}
+
+void Skeleton::Create(const std::vector<Node>& nodes) {
+	const auto count = static_cast<uint32_t>(nodes.size());
+	m_bones.clear();
+	m_bones.reserve(count);
+	m_parents.resize(count);
+	m_subtreeEnds.resize(count);
+	m_orders.resize(count);
+	m_dirty.assign(count, 0);
+	m_physicsGlobals.resize(count);
+	m_physicsWrites.assign(count, PhysicsWrite::None);
+	std::vector<const Node*> stack;
+	for (const auto& root : nodes) {
+		if (root.m_parent)
+			continue;
+		stack.push_back(&root);
+		while (!stack.empty()) {
+			const Node* node = stack.back();
+			stack.pop_back();
+			const auto order = static_cast<uint32_t>(m_bones.size());
+			m_orders[node->m_index] = order;
+			m_parents[order] = node->m_parent ? static_cast<int32_t>(m_orders[node->m_parent->m_index]) : -1;
+			m_subtreeEnds[order] = order + 1;
+			m_bones.push_back(node->m_index);
+			if (!node->m_child)
+				continue;
+			const Node* child = node->m_child->m_prev;
+			while (true) {
+				stack.push_back(child);
+				if (child == node->m_child)
+					break;
+				child = child->m_prev;
+			}
+		}
+	}
+	for (auto i = static_cast<int32_t>(m_bones.size()) - 1; i >= 0; i--) {
+		if (const int32_t parent = m_parents[i]; parent >= 0)
+			m_subtreeEnds[parent] = std::max(m_subtreeEnds[parent], m_subtreeEnds[i]);
+	}
+	m_firstDirty = static_cast<uint32_t>(m_bones.size());
+	m_firstPhysics = static_cast<uint32_t>(m_bones.size());
+}
+
+void Skeleton::Clear() {
+	m_pose.Clear();
+	m_bones.clear();
+	m_parents.clear();
+	m_subtreeEnds.clear();
+	m_orders.clear();
+	m_dirty.clear();
+	m_firstDirty = 0;
+	m_physicsGlobals.clear();
+	m_physicsWrites.clear();
+	m_firstPhysics = 0;
+}
+
+void Skeleton::MarkDirty(const Node* node) {
+	const uint32_t order = m_orders[node->m_index];
+	m_dirty[order] = 1;
+	m_firstDirty = std::min(m_firstDirty, order);
+}
+
+void Skeleton::MarkAllDirty() {
+	std::ranges::fill(m_dirty, 1);
+	m_firstDirty = 0;
+}
+
+void Skeleton::UpdateGlobalTransform() {
+	const auto count = static_cast<uint32_t>(m_bones.size());
+	const glm::mat4* locals = m_pose.m_locals.data();
+	glm::mat4* globals = m_pose.m_globals.data();
+	for (uint32_t i = m_firstDirty; i < count; i++) {
+		const int32_t parent = m_parents[i];
+		if (!m_dirty[i] && (parent < 0 || !m_dirty[parent]))
+			continue;
+		m_dirty[i] = 1;
+		const uint32_t bone = m_bones[i];
+		globals[bone] = parent >= 0 ? globals[m_bones[parent]] * locals[bone] : locals[bone];
+	}
+	std::fill(m_dirty.begin() + m_firstDirty, m_dirty.end(), 0);
+	m_firstDirty = count;
+}
+
+void Skeleton::UpdateSubtreeTransform(const Node* node) {
+	const glm::mat4* locals = m_pose.m_locals.data();
+	glm::mat4* globals = m_pose.m_globals.data();
+	const uint32_t begin = m_orders[node->m_index];
+	const uint32_t end = m_subtreeEnds[begin];
+	for (uint32_t i = begin; i < end; i++) {
+		const int32_t parent = m_parents[i];
+		const uint32_t bone = m_bones[i];
+		globals[bone] = parent >= 0 ? globals[m_bones[parent]] * locals[bone] : locals[bone];
+	}
+}
+
+void Skeleton::SetPhysicsGlobal(const Node* node, const glm::mat4& global, const PhysicsWrite write) {
+	const uint32_t order = m_orders[node->m_index];
+	m_physicsGlobals[order] = global;
+	m_physicsWrites[order] = write;
+	m_firstPhysics = std::min(m_firstPhysics, order);
+}
+
+void Skeleton::ApplyPhysicsTransform() {
+	const auto count = static_cast<uint32_t>(m_bones.size());
+	glm::mat4* locals = m_pose.m_locals.data();
+	glm::mat4* globals = m_pose.m_globals.data();
+	const uint32_t first = std::min(m_firstPhysics, m_firstDirty);
+	for (uint32_t i = first; i < count; i++) {
+		const int32_t parent = m_parents[i];
+		const uint32_t bone = m_bones[i];
+		const glm::mat4 parentGlobal = parent >= 0 ? globals[m_bones[parent]] : glm::mat4(1);
+		glm::mat4 global = parentGlobal * locals[bone];
+		if (m_physicsWrites[i] != PhysicsWrite::None) {
+			const glm::vec4 translate = global[3];
+			global = m_physicsGlobals[i];
+			if (m_physicsWrites[i] == PhysicsWrite::Rotate)
+				global[3] = translate;
+			locals[bone] = parent >= 0 ? glm::inverse(parentGlobal) * global : global;
+			m_physicsWrites[i] = PhysicsWrite::None;
+		}
+		globals[bone] = global;
+	}
+	std::fill(m_dirty.begin() + first, m_dirty.end(), 0);
+	m_firstDirty = count;
+	m_firstPhysics = count;
+}
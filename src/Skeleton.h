@@ -0,0 +1,44 @@
+﻿#pragma once
+
+#include "Node.h"
+
+enum class PhysicsWrite : uint8_t {
+	None,
+	Transform,
+	Rotate
+};
+
+struct NodeStage {
+	std::vector<std::vector<Node*>>	m_appendLevels;
+	std::vector<Node*>				m_ikNodes;
+};
+
+struct NodeSchedule {
+	std::vector<Node*>		m_nodes;
+	std::vector<Node*>		m_roots;
+	std::vector<NodeStage>	m_stages;
+
+	void Create(const std::vector<Node*>& sortedNodes, bool afterPhysics);
+};
+
+struct Skeleton {
+	NodePose				m_pose;
+	std::vector<uint32_t>	m_bones;
+	std::vector<int32_t>	m_parents;
+	std::vector<uint32_t>	m_subtreeEnds;
+	std::vector<uint32_t>	m_orders;
+	std::vector<uint8_t>	m_dirty;
+	uint32_t				m_firstDirty = 0;
+	std::vector<glm::mat4>		m_physicsGlobals;
+	std::vector<PhysicsWrite>	m_physicsWrites;
+	uint32_t					m_firstPhysics = 0;
+
+	void Create(const std::vector<Node>& nodes);
+	void Clear();
+	void MarkDirty(const Node* node);
+	void MarkAllDirty();
+	void UpdateGlobalTransform();
+	void UpdateSubtreeTransform(const Node* node);
+	void SetPhysicsGlobal(const Node* node, const glm::mat4& global, PhysicsWrite write);
+	void ApplyPhysicsTransform();
+};
@@ -62,6 +62,18 @@ std::pair<float, float> Sound::PullTimes() {
     return { static_cast<float>(dt), static_cast<float>(t) };
 }
 
+bool Sound::Seek(double timeSec) {
+    if (!m_hasSound)
+        return false;
+    timeSec = std::clamp(timeSec, 0.0, m_lengthSec);
+    const double sr = ma_engine_get_sample_rate(m_engine.get());
+    const auto frame = static_cast<ma_uint64>(timeSec * sr);
+    if (ma_sound_seek_to_pcm_frame(m_sound.get(), frame) != MA_SUCCESS)
+        return false;
+    m_prevTimeSec = sr > 0.0 ? static_cast<double>(frame) / sr : timeSec;
+    return true;
+}
+
 void Sound::Pause() const {
     if (!m_hasSound)
         return;
@@ -18,6 +18,7 @@ struct Sound {
     double GetLengthSec() const { return m_lengthSec; }
     void SetVolume(float volume);
     std::pair<float, float> PullTimes();
+    bool Seek(double timeSec);
     void Pause() const;
     void Resume();
     void Stop();
@@ -0,0 +1,316 @@
+﻿#include "SpringBone.h"
+
+#include "Node.h"
+#include "Physics.h"
+
+#include <xmmintrin.h>
+#include <glm/gtx/quaternion.hpp>
+
+float GetShapeRadius(const PMXReader::PMXRigidbody& pmxRigidBody) {
+	if (pmxRigidBody.m_shape == Shape::Box)
+		return glm::min(pmxRigidBody.m_shapeSize.x, glm::min(pmxRigidBody.m_shapeSize.y, pmxRigidBody.m_shapeSize.z));
+	return pmxRigidBody.m_shapeSize.x;
+}
+
+float GetJointStiffness(const PMXReader::PMXJoint* pmxJoint, const PMXReader::PMXRigidbody& pmxRigidBody,
+	const float length, const float timeStep) {
+	if (!pmxJoint || pmxRigidBody.m_mass <= 0.0f || length <= 0.0f)
+		return 0.0f;
+	const glm::vec3 spring = glm::abs(pmxJoint->m_springRotateFactor);
+	const float stiffness = (spring.x + spring.y + spring.z) / 3.0f;
+	return stiffness * timeStep * timeStep / (pmxRigidBody.m_mass * length * length);
+}
+
+void SpringBoneSolver::Create(const std::vector<PMXReader::PMXRigidbody>& pmxRigidBodies,
+	const std::vector<PMXReader::PMXJoint>& pmxJoints,
+	const std::vector<std::unique_ptr<RigidBody>>& rigidBodies,
+	std::vector<bool>& mapped) {
+	Clear();
+	const size_t bodyCount = rigidBodies.size();
+	mapped.assign(bodyCount, false);
+	std::vector<std::vector<size_t>> links(bodyCount);
+	for (const auto& joint : pmxJoints) {
+		const auto a = static_cast<size_t>(joint.m_rigidbodyAIndex);
+		const auto b = static_cast<size_t>(joint.m_rigidbodyBIndex);
+		if (joint.m_rigidbodyAIndex < 0 || joint.m_rigidbodyBIndex < 0 || a >= bodyCount || b >= bodyCount || a == b)
+			continue;
+		links[a].push_back(b);
+		links[b].push_back(a);
+	}
+	const auto findJoint = [&](const size_t a, const size_t b) -> const PMXReader::PMXJoint* {
+		for (const auto& joint : pmxJoints) {
+			if ((joint.m_rigidbodyAIndex == static_cast<int32_t>(a) && joint.m_rigidbodyBIndex == static_cast<int32_t>(b)) ||
+			    (joint.m_rigidbodyAIndex == static_cast<int32_t>(b) && joint.m_rigidbodyBIndex == static_cast<int32_t>(a)))
+				return &joint;
+		}
+		return nullptr;
+	};
+	const auto isSpring = [&](const size_t i) {
+		return pmxRigidBodies[i].m_op == Operation::Dynamic && rigidBodies[i]->m_node;
+	};
+	const auto isDriven = [&](const Node* node) {
+		for (size_t i = 0; i < bodyCount; i++) {
+			if (pmxRigidBodies[i].m_op != Operation::Static && rigidBodies[i]->m_node == node)
+				return true;
+		}
+		return false;
+	};
+	std::vector<size_t> chain;
+	for (size_t root = 0; root < bodyCount; root++) {
+		if (!isSpring(root) || mapped[root])
+			continue;
+		const Node* anchor = rigidBodies[root]->m_node->m_parent;
+		if (!anchor || isDriven(anchor))
+			continue;
+		size_t staticCount = 0;
+		size_t springCount = 0;
+		size_t staticLink = bodyCount;
+		for (const size_t link : links[root]) {
+			if (pmxRigidBodies[link].m_op == Operation::Static) {
+				staticLink = link;
+				staticCount++;
+			} else if (isSpring(link))
+				springCount++;
+		}
+		if (staticCount != 1 || springCount > 1 || staticCount + springCount != links[root].size())
+			continue;
+		chain.assign(1, root);
+		bool valid = true;
+		size_t prev = bodyCount;
+		size_t current = root;
+		while (true) {
+			size_t next = bodyCount;
+			for (const size_t link : links[current]) {
+				if (link == prev || pmxRigidBodies[link].m_op == Operation::Static)
+					continue;
+				next = link;
+			}
+			if (next == bodyCount)
+				break;
+			if (!isSpring(next) || mapped[next] || links[next].size() > 2 ||
+			    rigidBodies[next]->m_node->m_parent != rigidBodies[current]->m_node) {
+				valid = false;
+				break;
+			}
+			for (const size_t link : links[next]) {
+				if (link != current && pmxRigidBodies[link].m_op == Operation::Static)
+					valid = false;
+			}
+			if (!valid)
+				break;
+			chain.push_back(next);
+			prev = current;
+			current = next;
+		}
+		if (!valid || chain.size() < 2)
+			continue;
+		for (const size_t i : chain) {
+			if (glm::length(glm::vec3(rigidBodies[i]->m_offsetMat[3])) < 1.0e-4f)
+				valid = false;
+		}
+		if (!valid)
+			continue;
+		SpringBoneChain springChain;
+		springChain.m_begin = static_cast<uint32_t>(m_nodes.size());
+		springChain.m_anchor = rigidBodies[root]->m_node->m_parent;
+		for (size_t j = 0; j < chain.size(); j++) {
+			const size_t i = chain[j];
+			mapped[i] = true;
+			m_nodes.push_back(rigidBodies[i]->m_node);
+			m_centers.emplace_back(rigidBodies[i]->m_offsetMat[3]);
+			m_lengths.push_back(glm::length(m_centers.back()));
+			m_radii.push_back(GetShapeRadius(pmxRigidBodies[i]));
+			m_groups.push_back(rigidBodies[i]->m_group);
+			m_groupMasks.push_back(rigidBodies[i]->m_groupMask);
+			const float translateKeep = 1.0f - glm::clamp(pmxRigidBodies[i].m_translateDimmer, 0.0f, 1.0f);
+			const float rotateKeep = 1.0f - glm::clamp(pmxRigidBodies[i].m_rotateDimmer, 0.0f, 1.0f);
+			m_velocityScales.push_back(std::pow(translateKeep * rotateKeep, m_timeStep));
+			const PMXReader::PMXJoint* joint = findJoint(j == 0 ? staticLink : chain[j - 1], i);
+			const float jointStiffness = GetJointStiffness(joint, pmxRigidBodies[i], m_lengths.back(), m_timeStep);
+			m_stiffnesses.push_back(glm::clamp(m_stiffness + jointStiffness, 0.0f, 1.0f));
+		}
+		springChain.m_end = static_cast<uint32_t>(m_nodes.size());
+		m_chains.push_back(springChain);
+	}
+	if (m_chains.empty())
+		return;
+	for (size_t i = 0; i < bodyCount; i++) {
+		const auto& pmxRigidBody = pmxRigidBodies[i];
+		if (pmxRigidBody.m_op != Operation::Static || !rigidBodies[i]->m_node || pmxRigidBody.m_shape == Shape::Box)
+			continue;
+		SpringBoneCollider collider;
+		collider.m_node = rigidBodies[i]->m_node;
+		collider.m_offset = rigidBodies[i]->m_offsetMat;
+		collider.m_radius = pmxRigidBody.m_shapeSize.x;
+		collider.m_halfHeight = pmxRigidBody.m_shape == Shape::Capsule ? pmxRigidBody.m_shapeSize.y * 0.5f : 0.0f;
+		collider.m_group = rigidBodies[i]->m_group;
+		collider.m_groupMask = rigidBodies[i]->m_groupMask;
+		m_colliders.push_back(collider);
+	}
+	const size_t count = m_nodes.size();
+	const size_t paddedCount = (count + 3) & ~static_cast<size_t>(3);
+	m_animLocals.resize(count);
+	m_velocityScales.resize(paddedCount, 0.0f);
+	m_stiffnesses.resize(paddedCount, 0.0f);
+	for (auto* values : { &m_posX, &m_posY, &m_posZ, &m_prevX, &m_prevY, &m_prevZ, &m_targetX, &m_targetY, &m_targetZ })
+		values->assign(paddedCount, 0.0f);
+}
+
+void SpringBoneSolver::Clear() {
+	m_chains.clear();
+	m_colliders.clear();
+	m_nodes.clear();
+	m_centers.clear();
+	m_animLocals.clear();
+	m_lengths.clear();
+	m_radii.clear();
+	m_groups.clear();
+	m_groupMasks.clear();
+	for (auto* values : { &m_posX, &m_posY, &m_posZ, &m_prevX, &m_prevY, &m_prevZ, &m_targetX, &m_targetY, &m_targetZ, &m_velocityScales, &m_stiffnesses })
+		values->clear();
+	m_accumulator = 0;
+}
+
+void SpringBoneSolver::Reset() {
+	if (Empty())
+		return;
+	BeginUpdate();
+	m_posX = m_prevX = m_targetX;
+	m_posY = m_prevY = m_targetY;
+	m_posZ = m_prevZ = m_targetZ;
+	m_accumulator = 0;
+}
+
+void SpringBoneSolver::Update(const float elapsed) {
+	if (Empty())
+		return;
+	BeginUpdate();
+	m_accumulator += elapsed;
+	int stepCount = 0;
+	while (m_accumulator >= m_timeStep && stepCount < m_maxSubStepCount) {
+		Integrate(m_timeStep);
+		SolveConstraints();
+		m_accumulator -= m_timeStep;
+		stepCount++;
+	}
+	if (m_accumulator >= m_timeStep)
+		m_accumulator = std::fmod(m_accumulator, m_timeStep);
+	if (stepCount == 0)
+		SolveConstraints();
+}
+
+void SpringBoneSolver::GetState(std::vector<glm::vec3>& positions, std::vector<glm::vec3>& prevPositions) const {
+	const size_t count = m_nodes.size();
+	positions.resize(count);
+	prevPositions.resize(count);
+	for (size_t i = 0; i < count; i++) {
+		positions[i] = glm::vec3(m_posX[i], m_posY[i], m_posZ[i]);
+		prevPositions[i] = glm::vec3(m_prevX[i], m_prevY[i], m_prevZ[i]);
+	}
+}
+
+bool SpringBoneSolver::SetState(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& prevPositions) {
+	const size_t count = m_nodes.size();
+	if (positions.size() != count || prevPositions.size() != count)
+		return false;
+	for (size_t i = 0; i < count; i++) {
+		m_posX[i] = positions[i].x;
+		m_posY[i] = positions[i].y;
+		m_posZ[i] = positions[i].z;
+		m_prevX[i] = prevPositions[i].x;
+		m_prevY[i] = prevPositions[i].y;
+		m_prevZ[i] = prevPositions[i].z;
+	}
+	m_accumulator = 0;
+	return true;
+}
+
+void SpringBoneSolver::BeginUpdate() {
+	for (size_t i = 0; i < m_nodes.size(); i++) {
+		const Node* node = m_nodes[i];
+		m_animLocals[i] = node->GetLocal();
+		const auto target = glm::vec3(node->GetGlobal() * glm::vec4(m_centers[i], 1));
+		m_targetX[i] = target.x;
+		m_targetY[i] = target.y;
+		m_targetZ[i] = target.z;
+	}
+	for (auto& collider : m_colliders) {
+		const glm::mat4 transform = collider.m_node->GetGlobal() * collider.m_offset;
+		const auto center = glm::vec3(transform[3]);
+		const auto axis = glm::vec3(transform[1]) * collider.m_halfHeight;
+		collider.m_start = center - axis;
+		collider.m_end = center + axis;
+	}
+}
+
+void SpringBoneSolver::Integrate(const float dt) {
+	const __m128 gravityX = _mm_set1_ps(m_gravity.x * dt * dt);
+	const __m128 gravityY = _mm_set1_ps(m_gravity.y * dt * dt);
+	const __m128 gravityZ = _mm_set1_ps(m_gravity.z * dt * dt);
+	float* posAxes[3] = { m_posX.data(), m_posY.data(), m_posZ.data() };
+	float* prevAxes[3] = { m_prevX.data(), m_prevY.data(), m_prevZ.data() };
+	const float* targetAxes[3] = { m_targetX.data(), m_targetY.data(), m_targetZ.data() };
+	const __m128 gravities[3] = { gravityX, gravityY, gravityZ };
+	const float* velocityScales = m_velocityScales.data();
+	const float* stiffnesses = m_stiffnesses.data();
+	const size_t count = m_posX.size();
+	for (size_t i = 0; i < count; i += 4) {
+		const __m128 keep = _mm_loadu_ps(velocityScales + i);
+		const __m128 stiffness = _mm_loadu_ps(stiffnesses + i);
+		for (int axis = 0; axis < 3; axis++) {
+			const __m128 pos = _mm_loadu_ps(posAxes[axis] + i);
+			const __m128 prev = _mm_loadu_ps(prevAxes[axis] + i);
+			const __m128 target = _mm_loadu_ps(targetAxes[axis] + i);
+			__m128 next = _mm_add_ps(pos, _mm_mul_ps(_mm_sub_ps(pos, prev), keep));
+			next = _mm_add_ps(next, gravities[axis]);
+			next = _mm_add_ps(next, _mm_mul_ps(_mm_sub_ps(target, pos), stiffness));
+			_mm_storeu_ps(prevAxes[axis] + i, pos);
+			_mm_storeu_ps(posAxes[axis] + i, next);
+		}
+	}
+}
+
+void SpringBoneSolver::SolveConstraints() {
+	for (const auto& [begin, end, anchor] : m_chains) {
+		glm::mat4 parentGlobal = anchor->GetGlobal();
+		for (uint32_t i = begin; i < end; i++) {
+			glm::mat4 global = parentGlobal * m_animLocals[i];
+			const auto pivot = glm::vec3(global[3]);
+			glm::vec3 position(m_posX[i], m_posY[i], m_posZ[i]);
+			Collide(position, m_radii[i], m_groups[i], m_groupMasks[i]);
+			const glm::vec3 dir = position - pivot;
+			const float length = glm::length(dir);
+			if (length > 1.0e-6f)
+				position = pivot + dir * (m_lengths[i] / length);
+			m_posX[i] = position.x;
+			m_posY[i] = position.y;
+			m_posZ[i] = position.z;
+			const auto restDir = glm::normalize(glm::vec3(global * glm::vec4(m_centers[i], 1)) - pivot);
+			const auto newDir = glm::normalize(position - pivot);
+			const glm::quat rot = glm::rotation(restDir, newDir);
+			global = glm::translate(glm::mat4(1), pivot) * glm::mat4_cast(rot) * glm::translate(glm::mat4(1), -pivot) * global;
+			Node* node = m_nodes[i];
+			node->GetGlobal() = global;
+			node->GetLocal() = glm::inverse(parentGlobal) * global;
+			parentGlobal = global;
+		}
+	}
+}
+
+void SpringBoneSolver::Collide(glm::vec3& position, const float radius, const uint16_t group, const uint16_t groupMask) const {
+	for (const auto& collider : m_colliders) {
+		if (!(1 << collider.m_group & groupMask) || !(1 << group & collider.m_groupMask))
+			continue;
+		const glm::vec3 segment = collider.m_end - collider.m_start;
+		const float segmentLength = glm::dot(segment, segment);
+		float t = 0;
+		if (segmentLength > 1.0e-8f)
+			t = glm::clamp(glm::dot(position - collider.m_start, segment) / segmentLength, 0.0f, 1.0f);
+		const glm::vec3 closest = collider.m_start + segment * t;
+		const glm::vec3 diff = position - closest;
+		const float distance = glm::length(diff);
+		const float minDistance = collider.m_radius + radius;
+		if (distance < minDistance && distance > 1.0e-6f)
+			position = closest + diff * (minDistance / distance);
+	}
+}
@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "Reader.h"
+
+struct Node;
+struct RigidBody;
+
+struct SpringBoneCollider {
+	Node*		m_node;
+	glm::mat4	m_offset;
+	float		m_radius;
+	float		m_halfHeight;
+	uint16_t	m_group = 0;
+	uint16_t	m_groupMask = 0;
+	glm::vec3	m_start = glm::vec3(0);
+	glm::vec3	m_end = glm::vec3(0);
+};
+
+struct SpringBoneChain {
+	uint32_t	m_begin;
+	uint32_t	m_end;
+	Node*		m_anchor;
+};
+
+struct SpringBoneSolver {
+	std::vector<SpringBoneChain>	m_chains;
+	std::vector<SpringBoneCollider>	m_colliders;
+	std::vector<Node*>				m_nodes;
+	std::vector<glm::vec3>			m_centers;
+	std::vector<glm::mat4>			m_animLocals;
+	std::vector<float>				m_lengths;
+	std::vector<float>				m_radii;
+	std::vector<uint16_t>			m_groups;
+	std::vector<uint16_t>			m_groupMasks;
+	std::vector<float>				m_posX;
+	std::vector<float>				m_posY;
+	std::vector<float>				m_posZ;
+	std::vector<float>				m_prevX;
+	std::vector<float>				m_prevY;
+	std::vector<float>				m_prevZ;
+	std::vector<float>				m_targetX;
+	std::vector<float>				m_targetY;
+	std::vector<float>				m_targetZ;
+	std::vector<float>				m_velocityScales;
+	std::vector<float>				m_stiffnesses;
+	glm::vec3	m_gravity = glm::vec3(0, -9.8f * 10.0f, 0);
+	float		m_stiffness = 0.02f;
+	float		m_timeStep = 1.0f / 60.0f;
+	int			m_maxSubStepCount = 4;
+	float		m_accumulator = 0;
+
+	void Create(const std::vector<PMXReader::PMXRigidbody>& pmxRigidBodies,
+		const std::vector<PMXReader::PMXJoint>& pmxJoints,
+		const std::vector<std::unique_ptr<RigidBody>>& rigidBodies,
+		std::vector<bool>& mapped);
+	void Clear();
+	bool Empty() const { return m_chains.empty(); }
+	void Reset();
+	void Update(float elapsed);
+	void GetState(std::vector<glm::vec3>& positions, std::vector<glm::vec3>& prevPositions) const;
+	bool SetState(const std::vector<glm::vec3>& positions, const std::vector<glm::vec3>& prevPositions);
+
+private:
+	void BeginUpdate();
+	void Integrate(float dt);
+	void SolveConstraints();
+	void Collide(glm::vec3& position, float radius, uint16_t group, uint16_t groupMask) const;
+};
@@ -1,13 +1,21 @@
 ﻿#pragma once
 
+#ifdef _WIN32
 #include <windows.h>
+#endif
 
 struct Util {
-    static glm::mat4 InvZ(const glm::mat4& m) {
-        const glm::mat4 invZ = glm::scale(glm::mat4(1), glm::vec3(1, 1, -1));
-        return invZ * m * invZ;
+    static glm::mat4 InvZ(glm::mat4 m) {
+        m[0][2] = -m[0][2];
+        m[1][2] = -m[1][2];
+        m[3][2] = -m[3][2];
+        m[2][0] = -m[2][0];
+        m[2][1] = -m[2][1];
+        m[2][3] = -m[2][3];
+        return m;
     }
 
+#ifdef _WIN32
     static std::string WStringToUtf8(const std::wstring& w) {
         if (w.empty())
             return {};
@@ -26,4 +34,35 @@ struct Util {
             return {};
         return utf8;
     }
+#endif
+
+    static std::string Utf16ToUtf8(const std::u16string& u) {
+#ifdef _WIN32
+        return WStringToUtf8(std::wstring(u.begin(), u.end()));
+#else
+        std::string utf8;
+        utf8.reserve(u.size() * 3);
+        for (size_t i = 0; i < u.size(); i++) {
+            uint32_t c = u[i];
+            if (c >= 0xD800 && c < 0xDC00 && i + 1 < u.size() && u[i + 1] >= 0xDC00 && u[i + 1] < 0xE000)
+                c = 0x10000 + ((c - 0xD800) << 10) + (u[++i] - 0xDC00);
+            if (c < 0x80)
+                utf8 += static_cast<char>(c);
+            else if (c < 0x800) {
+                utf8 += static_cast<char>(0xC0 | c >> 6);
+                utf8 += static_cast<char>(0x80 | (c & 0x3F));
+            } else if (c < 0x10000) {
+                utf8 += static_cast<char>(0xE0 | c >> 12);
+                utf8 += static_cast<char>(0x80 | (c >> 6 & 0x3F));
+                utf8 += static_cast<char>(0x80 | (c & 0x3F));
+            } else {
+                utf8 += static_cast<char>(0xF0 | c >> 18);
+                utf8 += static_cast<char>(0x80 | (c >> 12 & 0x3F));
+                utf8 += static_cast<char>(0x80 | (c >> 6 & 0x3F));
+                utf8 += static_cast<char>(0x80 | (c & 0x3F));
+            }
+        }
+        return utf8;
+#endif
+    }
 };
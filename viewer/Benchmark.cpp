@@ -0,0 +1,186 @@
+#include "Benchmark.h"
+
+#include "../src/Model.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+struct LinearOverlapFilterCallback final : btOverlapFilterCallback {
+    std::vector<btBroadphaseProxy*> m_nonFilterProxy;
+
+    bool needBroadphaseCollision(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1) const override {
+        const auto endIt = m_nonFilterProxy.end();
+        if (std::ranges::find(m_nonFilterProxy, proxy0) != endIt || std::ranges::find(m_nonFilterProxy, proxy1) != endIt)
+            return true;
+        const int slot0 = proxy0->m_collisionFilterGroup >> Physics::ModelSlotShift & Physics::ModelSlotMask;
+        const int slot1 = proxy1->m_collisionFilterGroup >> Physics::ModelSlotShift & Physics::ModelSlotMask;
+        if (slot0 != slot1)
+            return false;
+        bool collides = (proxy0->m_collisionFilterGroup & proxy1->m_collisionFilterMask & Physics::GroupMask) != 0;
+        collides = collides && (proxy1->m_collisionFilterGroup & proxy0->m_collisionFilterMask & Physics::GroupMask) != 0;
+        return collides;
+    }
+};
+
+bool Benchmark::RunPhysics(const SceneConfig& cfg, std::vector<PhysicsBenchmarkResult>& results) const {
+    results.clear();
+    for (const auto& modelConfig : cfg.m_modelConfigs) {
+        PhysicsBenchmarkResult result;
+        if (!MeasurePhysics(modelConfig, false, JointMode::Typed, result, result.m_singleThreadMs) ||
+            !MeasurePhysics(modelConfig, true, JointMode::Typed, result, result.m_multiThreadMs))
+            return false;
+        std::cout << result.m_modelName
+            << " rigid bodies " << result.m_rigidBodyCount
+            << " joints " << result.m_jointCount
+            << " single " << result.m_singleThreadMs << " ms"
+            << " multi " << result.m_multiThreadMs << " ms"
+            << " speedup " << result.m_singleThreadMs / result.m_multiThreadMs << "x\n";
+        results.emplace_back(std::move(result));
+    }
+    return true;
+}
+
+bool Benchmark::RunJoints(const SceneConfig& cfg, std::vector<JointBenchmarkResult>& results) const {
+    results.clear();
+    for (const auto& modelConfig : cfg.m_modelConfigs) {
+        PhysicsBenchmarkResult physicsResult;
+        JointBenchmarkResult result;
+        if (!MeasurePhysics(modelConfig, false, JointMode::Generic6DofSpring, physicsResult, result.m_generic6DofSpringMs) ||
+            !MeasurePhysics(modelConfig, false, JointMode::Typed, physicsResult, result.m_typedMs, &result.m_simplifiedJointCount) ||
+            !MeasurePhysics(modelConfig, false, JointMode::TypedSpring2, physicsResult, result.m_typedSpring2Ms))
+            return false;
+        result.m_modelName = physicsResult.m_modelName;
+        result.m_jointCount = physicsResult.m_jointCount;
+        std::cout << result.m_modelName
+            << " joints " << result.m_jointCount
+            << " simplified " << result.m_simplifiedJointCount
+            << " 6dof spring " << result.m_generic6DofSpringMs << " ms"
+            << " typed " << result.m_typedMs << " ms"
+            << " typed spring2 " << result.m_typedSpring2Ms << " ms\n";
+        results.emplace_back(std::move(result));
+    }
+    return true;
+}
+
+bool Benchmark::RunWarmUp(const SceneConfig& cfg, std::vector<WarmUpBenchmarkResult>& results) const {
+    results.clear();
+    for (const auto& modelConfig : cfg.m_modelConfigs) {
+        const auto model = std::make_shared<Model>();
+        if (!model->Load(modelConfig.m_modelPath, m_pmxDir)) {
+            std::cout << "Failed to load pmx file.\n";
+            return false;
+        }
+        Animation anim;
+        anim.m_model = model;
+        for (const auto& vmdPath : modelConfig.m_animPaths) {
+            VMDReader vmd;
+            if (!vmd.ReadFile(vmdPath.c_str()) || !anim.Add(vmd)) {
+                std::cout << "Failed to read VMD file.\n";
+                return false;
+            }
+        }
+        const auto measure = [&model, &anim](const bool fast) {
+            model->m_fastPhysicsWarmUp = fast;
+            model->InitializeAnimation();
+            const auto start = std::chrono::steady_clock::now();
+            anim.SyncPhysics(0.0f);
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000.0;
+        };
+        WarmUpBenchmarkResult result;
+        result.m_modelName = model->m_modelName;
+        result.m_fullMs = measure(false);
+        result.m_fastMs = measure(true);
+        std::cout << result.m_modelName
+            << " full " << result.m_fullMs << " ms"
+            << " fast " << result.m_fastMs << " ms"
+            << " saved " << result.m_fullMs - result.m_fastMs << " ms\n";
+        results.emplace_back(std::move(result));
+    }
+    return true;
+}
+
+bool Benchmark::MeasurePhysics(const ModelConfig& modelConfig, const bool multiThreaded, const JointMode jointMode,
+    PhysicsBenchmarkResult& result, double& ms, size_t* simplifiedJointCount) const {
+    const auto model = std::make_shared<Model>();
+    model->m_multiThreadedPhysics = multiThreaded;
+    model->m_jointMode = jointMode;
+    if (!model->Load(modelConfig.m_modelPath, m_pmxDir)) {
+        std::cout << "Failed to load pmx file.\n";
+        return false;
+    }
+    model->InitializeAnimation();
+    Animation anim;
+    anim.m_model = model;
+    for (const auto& vmdPath : modelConfig.m_animPaths) {
+        VMDReader vmd;
+        if (!vmd.ReadFile(vmdPath.c_str()) || !anim.Add(vmd)) {
+            std::cout << "Failed to read VMD file.\n";
+            return false;
+        }
+    }
+    anim.SyncPhysics(0.0f);
+    double physicsSec = 0.0;
+    for (int i = 0; i < m_frameCount; i++) {
+        model->BeginAnimation();
+        anim.Evaluate(static_cast<float>(i) * m_elapsed * 30.0f);
+        model->UpdateMorphAnimation();
+        model->UpdateNodeAnimation(false);
+        const auto start = std::chrono::steady_clock::now();
+        model->UpdatePhysicsAnimation(m_elapsed);
+        physicsSec += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        model->UpdateNodeAnimation(true);
+    }
+    result.m_modelName = model->m_modelName;
+    result.m_rigidBodyCount = model->m_rigidBodies.size();
+    result.m_jointCount = model->m_joints.size();
+    if (simplifiedJointCount) {
+        *simplifiedJointCount = std::ranges::count_if(model->m_joints, [](const std::unique_ptr<Joint>& joint) {
+            return joint->m_constraint->getConstraintType() != D6_SPRING_CONSTRAINT_TYPE;
+        });
+    }
+    ms = physicsSec * 1000.0 / m_frameCount;
+    return true;
+}
+
+OverlapFilterBenchmarkResult Benchmark::RunOverlapFilter() const {
+    constexpr size_t ModelCount = 6;
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int> groupDist(0, 15);
+    std::uniform_int_distribution<int> maskDist(0, 0xFFFF);
+    std::vector<btBroadphaseProxy> proxies;
+    proxies.reserve(m_proxyCount + 1);
+    const btVector3 aabb(0, 0, 0);
+    for (size_t i = 0; i < m_proxyCount; i++) {
+        const auto slot = static_cast<uint16_t>(i % ModelCount);
+        proxies.emplace_back(aabb, aabb, nullptr, Physics::MakeFilterGroup(1 << groupDist(rng), slot), maskDist(rng));
+    }
+    proxies.emplace_back(aabb, aabb, nullptr, Physics::NonFilterGroup, btBroadphaseProxy::AllFilter);
+    std::uniform_int_distribution<size_t> proxyDist(0, proxies.size() - 1);
+    std::vector<std::pair<btBroadphaseProxy*, btBroadphaseProxy*>> pairs(m_pairCount);
+    for (auto& [proxy0, proxy1] : pairs) {
+        proxy0 = &proxies[proxyDist(rng)];
+        proxy1 = &proxies[proxyDist(rng)];
+    }
+    LinearOverlapFilterCallback linear;
+    linear.m_nonFilterProxy.push_back(&proxies.back());
+    const OverlapFilterCallback flag;
+    const auto measure = [&pairs](const btOverlapFilterCallback& callback, size_t& collideCount) {
+        collideCount = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (const auto& [proxy0, proxy1] : pairs)
+            collideCount += callback.needBroadphaseCollision(proxy0, proxy1) ? 1 : 0;
+        const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return sec * 1.0e9 / static_cast<double>(pairs.size());
+    };
+    OverlapFilterBenchmarkResult result;
+    size_t linearCollideCount = 0;
+    result.m_linearNsPerPair = measure(linear, linearCollideCount);
+    result.m_flagNsPerPair = measure(flag, result.m_collideCount);
+    std::cout << "overlap filter pairs " << pairs.size()
+        << " linear " << result.m_linearNsPerPair << " ns"
+        << " flag " << result.m_flagNsPerPair << " ns"
+        << " collide " << result.m_collideCount << "/" << linearCollideCount << "\n";
+    return result;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Viewer.h"
+
+struct PhysicsBenchmarkResult {
+    std::string m_modelName;
+    size_t      m_rigidBodyCount = 0;
+    size_t      m_jointCount = 0;
+    double      m_singleThreadMs = 0.0;
+    double      m_multiThreadMs = 0.0;
+};
+
+struct JointBenchmarkResult {
+    std::string m_modelName;
+    size_t      m_jointCount = 0;
+    size_t      m_simplifiedJointCount = 0;
+    double      m_generic6DofSpringMs = 0.0;
+    double      m_typedMs = 0.0;
+    double      m_typedSpring2Ms = 0.0;
+};
+
+struct WarmUpBenchmarkResult {
+    std::string m_modelName;
+    double      m_fullMs = 0.0;
+    double      m_fastMs = 0.0;
+};
+
+struct OverlapFilterBenchmarkResult {
+    double  m_linearNsPerPair = 0.0;
+    double  m_flagNsPerPair = 0.0;
+    size_t  m_collideCount = 0;
+};
+
+struct Benchmark {
+    std::filesystem::path   m_pmxDir;
+    int                     m_frameCount = 600;
+    float                   m_elapsed = 1.0f / 60.0f;
+    size_t                  m_proxyCount = 2048;
+    size_t                  m_pairCount = 1 << 22;
+
+    bool RunPhysics(const SceneConfig& cfg, std::vector<PhysicsBenchmarkResult>& results) const;
+    bool RunJoints(const SceneConfig& cfg, std::vector<JointBenchmarkResult>& results) const;
+    bool RunWarmUp(const SceneConfig& cfg, std::vector<WarmUpBenchmarkResult>& results) const;
+    OverlapFilterBenchmarkResult RunOverlapFilter() const;
+
+private:
+    bool MeasurePhysics(const ModelConfig& modelConfig, bool multiThreaded, JointMode jointMode,
+        PhysicsBenchmarkResult& result, double& ms, size_t* simplifiedJointCount = nullptr) const;
+};
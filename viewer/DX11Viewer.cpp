@@ -128,7 +128,7 @@ bool DX11Instance::Setup(Viewer& viewer) {
 		return false;
 	if (FAILED(CreateBuffer<DX11GroundShadowPixelShader>(m_viewer->m_device.Get(), m_gsPsConstantBuffer)))
 		return false;
-	for (const auto& mat : m_model->m_materials) {
+	for (const auto& mat : m_model->m_drawMaterials) {
 		DX11Material m(mat);
 		if (!mat.m_texture.empty())
 			m.m_texture = m_viewer->GetTexture(mat.m_texture);
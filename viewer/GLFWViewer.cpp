@@ -213,7 +213,7 @@ bool GLFWInstance::Setup(Viewer& viewer) {
 	m_vao = CreateVAO(buffers[0], locs[0], sizes[0], types[0], 3, m_ibo);
 	m_edgeVao = CreateVAO(buffers[1], locs[1], sizes[1], types[1], 2, m_ibo);
 	m_gsVao = CreateVAO(buffers[2], locs[2], sizes[2], types[2], 1, m_ibo);
-	for (const auto& mat : m_model->m_materials) {
+	for (const auto& mat : m_model->m_drawMaterials) {
 		GLFWMaterial m(mat);
 		if (!mat.m_texture.empty()) {
 			auto [m_texture, m_hasAlpha] = m_viewer->GetTexture(mat.m_texture);
@@ -1,5 +1,6 @@
 #include "Viewer.h"
 
+#include "../src/JobPool.h"
 #include "../src/Model.h"
 #include "../src/Sound.h"
 
@@ -9,25 +10,85 @@
 #include <iostream>
 #include <windows.h>
 
-void TickFps(std::chrono::steady_clock::time_point& fpsTime, int& fpsFrame) {
+bool TickFps(std::chrono::steady_clock::time_point& fpsTime, int& fpsFrame) {
     fpsFrame++;
     const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - fpsTime).count();
-    if (sec > 1.0) {
-        std::cout << (fpsFrame / sec) << " fps\n";
-        fpsFrame = 0;
-        fpsTime = std::chrono::steady_clock::now();
+    if (sec <= 1.0)
+        return false;
+    std::cout << (fpsFrame / sec) << " fps\n";
+    fpsFrame = 0;
+    fpsTime = std::chrono::steady_clock::now();
+    return true;
+}
+
+void Instance::SyncPhysics(const float frame) {
+    const auto frameIndex = static_cast<int32_t>(frame);
+    if (const auto* snapshot = m_physicsCache.Find(frameIndex)) {
+        if (m_anim->RestorePhysics(frame, *snapshot))
+            return;
+    }
+    const auto start = std::chrono::steady_clock::now();
+    m_anim->SyncPhysics(frame);
+    const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << m_model->m_modelName << " physics warm-up "
+        << (m_model->m_fastPhysicsWarmUp ? "(fast) " : "") << sec * 1000.0 << " ms\n";
+    if (!m_physicsCache.m_path.empty())
+        StorePhysicsSnapshot(frameIndex);
+}
+
+void Instance::StorePhysicsSnapshot(const int32_t frame) {
+    PhysicsSnapshot snapshot;
+    snapshot.m_frame = frame;
+    m_model->SavePhysicsSnapshot(snapshot);
+    m_physicsCache.Store(std::move(snapshot));
+    if (!m_physicsCache.Save())
+        std::cout << "Failed to save physics cache.\n";
+}
+
+void Instance::Seek(const float frame, const float preRollFrames) {
+    const auto frameIndex = static_cast<int32_t>(frame);
+    float begin = max(frame - preRollFrames, 0.0f);
+    const auto* snapshot = m_physicsCache.FindNearest(frameIndex);
+    if (snapshot && static_cast<float>(snapshot->m_frame) >= begin &&
+        m_anim->RestorePhysics(static_cast<float>(snapshot->m_frame), *snapshot))
+        begin = static_cast<float>(snapshot->m_frame);
+    else
+        m_anim->ResetPhysics(begin);
+    const auto settledFrame = static_cast<float>(frameIndex);
+    if (m_physicsCache.m_path.empty() || begin >= settledFrame) {
+        m_anim->PreRollPhysics(begin, frame);
+        return;
     }
+    m_anim->PreRollPhysics(begin, settledFrame);
+    StorePhysicsSnapshot(frameIndex);
+    m_anim->PreRollPhysics(settledFrame, frame);
 }
 
 void Instance::UpdateAnimation(const Viewer& viewer) const {
+    m_model->SelectPhysicsLod(viewer.m_viewMat * glm::scale(glm::mat4(1), glm::vec3(m_scale)), viewer.m_projMat);
     m_model->BeginAnimation();
     m_model->UpdateAllAnimation(m_anim.get(), viewer.m_animTime * 30.0f, viewer.m_elapsed);
 }
 
+void Instance::BeginUpdateAnimation(const Viewer& viewer) const {
+    m_model->SelectPhysicsLod(viewer.m_viewMat * glm::scale(glm::mat4(1), glm::vec3(m_scale)), viewer.m_projMat);
+    m_model->BeginAnimation();
+    m_model->BeginAllAnimation(m_anim.get(), viewer.m_animTime * 30.0f);
+}
+
+void Instance::EndUpdateAnimation(const Viewer& viewer) const {
+    m_model->EndAllAnimation(viewer.m_elapsed);
+}
+
 bool Viewer::Run(const SceneConfig& cfg) {
     Sound music;
     music.Init(cfg.m_musicPath, false);
     m_paused = false;
+    m_seekRequested = false;
+    m_seekPreRollTime = cfg.m_seekPreRollTime;
+    m_logPhysicsStats = cfg.m_logPhysicsStats;
+    m_prevLeftDown = false;
+    m_prevRightDown = false;
     m_prevSpaceDown = false;
     m_useMotionCamera = true;
     m_hasFreeCameraState = false;
@@ -66,6 +127,10 @@ bool Viewer::Run(const SceneConfig& cfg) {
     while (!glfwWindowShouldClose(m_window)) {
         glfwPollEvents();
         HandleInput(music);
+        if (m_seekRequested) {
+            Seek(instances, music, m_seekTime);
+            m_seekRequested = false;
+        }
         int newW = 0, newH = 0;
         glfwGetFramebufferSize(m_window, &newW, &newH);
         if (newW != m_screenWidth || newH != m_screenHeight) {
@@ -77,18 +142,32 @@ bool Viewer::Run(const SceneConfig& cfg) {
         StepTime(music, saveTime);
         UpdateCamera();
         BeginFrame();
-        for (const auto& instance : instances) {
-            instance->UpdateAnimation(*this);
-            instance->Update();
-            instance->Draw();
+        UpdateInstances(instances);
+        if (m_physicsMode == ScenePhysicsMode::Pipelined) {
+            for (const auto& instance : instances)
+                instance->m_model->SaveDrawState();
+            SubmitInstances(instances);
+            for (const auto& instance : instances) {
+                instance->Update();
+                instance->Draw();
+            }
+        } else {
+            for (const auto& instance : instances) {
+                instance->Update();
+                instance->Draw();
+            }
         }
         if (!EndFrame())
             break;
-        TickFps(fpsTime, fpsFrame);
+        if (TickFps(fpsTime, fpsFrame) && m_logPhysicsStats) {
+            for (const auto& instance : instances)
+                instance->m_model->LogPhysicsStats();
+        }
     }
     for (const auto& instance : instances)
         instance->Clear();
     instances.clear();
+    m_scenePhysics.reset();
     glfwTerminate();
     return true;
 }
@@ -104,6 +183,19 @@ void Viewer::HandleInput(Sound& music) {
     }
     m_prevSpaceDown = spaceDown;
 
+    const bool leftDown = glfwGetKey(m_window, GLFW_KEY_LEFT) == GLFW_PRESS;
+    const bool rightDown = glfwGetKey(m_window, GLFW_KEY_RIGHT) == GLFW_PRESS;
+    if (leftDown && !m_prevLeftDown) {
+        m_seekTime = m_animTime - 10.0f;
+        m_seekRequested = true;
+    }
+    if (rightDown && !m_prevRightDown) {
+        m_seekTime = m_animTime + 10.0f;
+        m_seekRequested = true;
+    }
+    m_prevLeftDown = leftDown;
+    m_prevRightDown = rightDown;
+
     const bool rDown = glfwGetKey(m_window, GLFW_KEY_R) == GLFW_PRESS;
     if (rDown && !m_prevRDown) {
         if (m_useMotionCamera && !m_hasFreeCameraState) {
@@ -174,15 +266,35 @@ unsigned char* Viewer::LoadImageRGBA(const std::filesystem::path& texturePath, i
 bool Viewer::LoadInstances(const SceneConfig& cfg, std::vector<std::unique_ptr<Instance>>& instances) {
     instances.clear();
     instances.reserve(cfg.m_modelConfigs.size());
-    for (const auto& [modelPath, vmdPaths, scale] : cfg.m_modelConfigs) {
+    m_scenePhysics.reset();
+    m_physicsMode = cfg.m_physicsMode;
+    if (m_physicsMode == ScenePhysicsMode::Shared) {
+        m_scenePhysics = std::make_shared<Physics>();
+        m_scenePhysics->m_interModelCollision = cfg.m_interModelCollision;
+        m_scenePhysics->m_fixedTimeStep = cfg.m_fixedTimeStepPhysics;
+        m_scenePhysics->Create();
+    }
+    for (const auto& [modelPath, vmdPaths, physicsTrackPath, scale] : cfg.m_modelConfigs) {
         auto instance = CreateInstance();
         const auto pmxModel = std::make_shared<Model>();
+        pmxModel->m_scenePhysics = m_scenePhysics;
+        pmxModel->m_fixedTimeStepPhysics = cfg.m_fixedTimeStepPhysics;
+        pmxModel->m_pipelinedPhysics = m_physicsMode == ScenePhysicsMode::Pipelined;
+        pmxModel->m_fastPhysicsWarmUp = cfg.m_fastPhysicsWarmUp;
         if (!pmxModel->Load(modelPath, m_pmxDir)) {
             std::cout << "Failed to load pmx file.\n";
             return false;
         }
         instance->m_model = pmxModel;
         instance->m_model->InitializeAnimation();
+        if (!physicsTrackPath.empty()) {
+            auto track = std::make_shared<PhysicsTrack>();
+            if (track->Load(physicsTrackPath) && track->IsCompatible(*pmxModel, PhysicsCache::MakeKey(*pmxModel, modelPath, vmdPaths))) {
+                pmxModel->m_physicsTrack = std::move(track);
+                pmxModel->SetBakedPhysics(true);
+            } else
+                std::cout << "Failed to load physics track.\n";
+        }
         auto vmdAnim = std::make_unique<Animation>();
         vmdAnim->m_model = instance->m_model;
         for (const auto& vmdPath : vmdPaths) {
@@ -196,16 +308,134 @@ bool Viewer::LoadInstances(const SceneConfig& cfg, std::vector<std::unique_ptr<I
                 return false;
             }
         }
-        vmdAnim->SyncPhysics(0.0f);
         instance->m_anim = std::move(vmdAnim);
         instance->m_scale = scale;
+        if (!m_scenePhysics) {
+            if (cfg.m_usePhysicsCache) {
+                instance->m_physicsCache.m_path = PhysicsCache::MakePath(m_cacheDir, *pmxModel, modelPath, vmdPaths);
+                instance->m_physicsCache.Load();
+            }
+            instance->SyncPhysics(0.0f);
+        }
         if (!instance->Setup(*this))
             return false;
         instances.emplace_back(std::move(instance));
     }
+    if (m_scenePhysics)
+        SyncScenePhysics(instances);
     return true;
 }
 
+void Viewer::SyncScenePhysics(const std::vector<std::unique_ptr<Instance>>& instances) const {
+    for (const auto& instance : instances)
+        instance->m_model->BeginResetPhysics();
+    EndResetScenePhysics(instances);
+    for (const auto& instance : instances)
+        instance->m_model->SaveBaseAnimation();
+    for (int i = 0; i < 30; i++) {
+        for (const auto& instance : instances) {
+            instance->m_model->BeginAnimation();
+            instance->m_anim->Evaluate(0.0f, static_cast<float>(1 + i) / 30.0f);
+            instance->m_model->UpdateMorphAnimation();
+            instance->m_model->UpdateNodeAnimation(false);
+            instance->m_model->BeginPhysicsAnimation();
+        }
+        m_scenePhysics->Step(1.0f / 30.0f);
+        for (const auto& instance : instances) {
+            instance->m_model->EndPhysicsAnimation(1.0f / 30.0f);
+            instance->m_model->UpdateNodeAnimation(true);
+        }
+    }
+}
+
+void Viewer::UpdateInstances(const std::vector<std::unique_ptr<Instance>>& instances) const {
+    if (m_physicsMode == ScenePhysicsMode::PerModel) {
+        for (const auto& instance : instances)
+            instance->UpdateAnimation(*this);
+        return;
+    }
+    if (m_physicsMode == ScenePhysicsMode::Pipelined) {
+        for (const auto& instance : instances) {
+            if (instance->m_updatePending)
+                instance->EndUpdateAnimation(*this);
+            instance->m_updatePending = false;
+        }
+        return;
+    }
+    for (const auto& instance : instances)
+        instance->BeginUpdateAnimation(*this);
+    if (m_physicsMode == ScenePhysicsMode::Shared) {
+        m_scenePhysics->Step(m_elapsed);
+        for (const auto& instance : instances)
+            instance->EndUpdateAnimation(*this);
+        return;
+    }
+    JobPool::Get().ParallelFor(instances.size(), 1, [this, &instances](const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            instances[i]->m_model->StepPhysics(m_elapsed);
+            instances[i]->EndUpdateAnimation(*this);
+        }
+    });
+}
+
+void Viewer::SubmitInstances(const std::vector<std::unique_ptr<Instance>>& instances) const {
+    for (const auto& instance : instances) {
+        instance->BeginUpdateAnimation(*this);
+        instance->m_model->StepPhysics(m_elapsed);
+        instance->m_updatePending = true;
+    }
+}
+
+void Viewer::Seek(const std::vector<std::unique_ptr<Instance>>& instances, Sound& music, float time) {
+    const auto start = std::chrono::steady_clock::now();
+    time = max(time, 0.0f);
+    if (music.m_hasSound) {
+        time = min(time, static_cast<float>(music.GetLengthSec()));
+        music.Seek(time);
+    }
+    m_animTime = time;
+    m_elapsed = 0.0f;
+    const float frame = m_animTime * 30.0f;
+    const float preRollFrames = m_seekPreRollTime * 30.0f;
+    if (m_scenePhysics)
+        SeekScenePhysics(instances, max(frame - preRollFrames, 0.0f), frame);
+    else {
+        for (const auto& instance : instances) {
+            instance->Seek(frame, preRollFrames);
+            instance->m_updatePending = false;
+        }
+    }
+    const double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Seek to " << m_animTime << " s took " << sec * 1000.0 << " ms\n";
+}
+
+void Viewer::SeekScenePhysics(const std::vector<std::unique_ptr<Instance>>& instances, const float begin, const float end) const {
+    for (const auto& instance : instances)
+        instance->m_anim->BeginResetPhysics(begin);
+    EndResetScenePhysics(instances);
+    float frame = begin;
+    while (frame < end) {
+        const float next = min(frame + 1.0f, end);
+        const float elapsed = (next - frame) / 30.0f;
+        for (const auto& instance : instances) {
+            instance->m_model->BeginAnimation();
+            instance->m_model->BeginAllAnimation(instance->m_anim.get(), next);
+        }
+        m_scenePhysics->Step(elapsed);
+        for (const auto& instance : instances)
+            instance->m_model->EndAllAnimation(elapsed);
+        frame = next;
+    }
+}
+
+void Viewer::EndResetScenePhysics(const std::vector<std::unique_ptr<Instance>>& instances) const {
+    m_scenePhysics->StepReset();
+    for (const auto& instance : instances) {
+        instance->m_model->EndResetPhysics();
+        instance->m_model->UpdateNodeAnimation(true);
+    }
+}
+
 void Viewer::LoadCameraAnim(const SceneConfig& cfg) {
     m_cameraAnim.reset();
     if (cfg.m_cameraAnim.empty()) {
@@ -287,4 +517,5 @@ void Viewer::InitDirs(const std::filesystem::path& shaderSubDir) {
     m_resourceDir = m_resourceDir.parent_path() / "resource";
     m_shaderDir = m_resourceDir / shaderSubDir;
     m_pmxDir = m_resourceDir / "mmd";
+    m_cacheDir = m_resourceDir / "cache";
 }
@@ -5,17 +5,27 @@
 #include <filesystem>
 
 #include "../src/Animation.h"
+#include "../src/PhysicsCache.h"
 #include "../src/Sound.h"
 
 struct SceneConfig;
 struct Material;
 struct Viewer;
 struct Animation;
+struct Physics;
 class Model;
 
+enum class ScenePhysicsMode : uint8_t {
+    PerModel,
+    Shared,
+    Parallel,
+    Pipelined
+};
+
 struct ModelConfig {
     std::filesystem::path				m_modelPath;
     std::vector<std::filesystem::path>	m_animPaths;
+    std::filesystem::path				m_physicsTrackPath;
     float								m_scale = 1.0f;
 };
 
@@ -23,6 +33,13 @@ struct SceneConfig {
     std::vector<ModelConfig>    m_modelConfigs;
     std::filesystem::path	    m_cameraAnim;
     std::filesystem::path	    m_musicPath;
+    ScenePhysicsMode            m_physicsMode = ScenePhysicsMode::PerModel;
+    bool                        m_interModelCollision = false;
+    bool                        m_fixedTimeStepPhysics = false;
+    bool                        m_usePhysicsCache = true;
+    bool                        m_fastPhysicsWarmUp = true;
+    float                       m_seekPreRollTime = 1.0f;
+    bool                        m_logPhysicsStats = false;
 };
 
 struct Instance {
@@ -30,14 +47,21 @@ struct Instance {
 
     std::shared_ptr<Model>	    m_model;
     std::unique_ptr<Animation>	m_anim;
+    PhysicsCache                m_physicsCache;
     float m_scale;
+    bool m_updatePending = false;
 
     virtual bool Setup(Viewer& viewer) = 0;
     virtual void Update() const = 0;
     virtual void Draw() const = 0;
     virtual void Clear() {}
 
+    void SyncPhysics(float frame);
+    void StorePhysicsSnapshot(int32_t frame);
+    void Seek(float frame, float preRollFrames);
     void UpdateAnimation(const Viewer& viewer) const;
+    void BeginUpdateAnimation(const Viewer& viewer) const;
+    void EndUpdateAnimation(const Viewer& viewer) const;
 };
 
 struct Viewer {
@@ -46,6 +70,7 @@ struct Viewer {
     std::filesystem::path	m_resourceDir;
     std::filesystem::path	m_shaderDir;
     std::filesystem::path	m_pmxDir;
+    std::filesystem::path	m_cacheDir;
     glm::mat4	m_viewMat;
     glm::mat4	m_projMat;
     int			m_screenWidth = 0;
@@ -55,6 +80,12 @@ struct Viewer {
     float	m_elapsed = 0.0f;
     float	m_animTime = 0.0f;
     bool    m_paused = false;
+    bool    m_seekRequested = false;
+    float   m_seekTime = 0.0f;
+    float   m_seekPreRollTime = 1.0f;
+    bool    m_logPhysicsStats = false;
+    bool    m_prevLeftDown = false;
+    bool    m_prevRightDown = false;
     bool    m_prevSpaceDown = false;
     bool    m_useMotionCamera = true;
     bool    m_hasFreeCameraState = false;
@@ -66,6 +97,8 @@ struct Viewer {
     float   m_freeCamYaw = glm::radians(-90.0f);
     float   m_freeCamPitch = 0.0f;
     std::unique_ptr<CameraAnimation>	m_cameraAnim;
+    std::shared_ptr<Physics>            m_scenePhysics;
+    ScenePhysicsMode                    m_physicsMode = ScenePhysicsMode::PerModel;
     float m_clearColor[4] = { 0.839f, 0.902f, 0.961f, 1.0f };
     GLFWwindow* m_window = nullptr;
 
@@ -81,6 +114,12 @@ struct Viewer {
     static unsigned char* LoadImageRGBA(const std::filesystem::path& texturePath, int& x, int& y, int& comp, bool flipY = false);
     bool LoadInstances(const SceneConfig& cfg, std::vector<std::unique_ptr<Instance>>& instances);
     void LoadCameraAnim(const SceneConfig& cfg);
+    void SyncScenePhysics(const std::vector<std::unique_ptr<Instance>>& instances) const;
+    void UpdateInstances(const std::vector<std::unique_ptr<Instance>>& instances) const;
+    void SubmitInstances(const std::vector<std::unique_ptr<Instance>>& instances) const;
+    void Seek(const std::vector<std::unique_ptr<Instance>>& instances, Sound& music, float time);
+    void SeekScenePhysics(const std::vector<std::unique_ptr<Instance>>& instances, float begin, float end) const;
+    void EndResetScenePhysics(const std::vector<std::unique_ptr<Instance>>& instances) const;
     void StepTime(Sound& music, std::chrono::steady_clock::time_point& saveTime);
     void HandleInput(Sound& music);
     void UpdateCamera();